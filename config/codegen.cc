@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "codegen.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+namespace {
+
+// A single setting from the schema, split into its parts.
+struct Field {
+	string key;
+	string identifier;
+	config::Item item;
+};
+
+// Escape a value for use inside a C++ string literal.
+string Quote(std::string_view in) {
+	string out = "\"";
+	for (const auto& c : in) {
+		switch (c) {
+			case '\\': out += "\\\\"; break;
+			case '\"': out += "\\\""; break;
+			case '\n': out += "\\n"; break;
+			case '\t': out += "\\t"; break;
+			default: out += c;
+		}
+	}
+	out += "\"";
+	return out;
+}
+
+// Turn "http-common_123" into "HttpCommon123Section".
+string ToStructName(const string& identifier) {
+	string out = "";
+	bool upper = true;
+	for (const auto& c : identifier) {
+		if (c == '_') {
+			upper = true;
+			continue;
+		}
+		out += upper ? static_cast<char>(std::toupper(c)) : c;
+		upper = false;
+	}
+	return out + "Section";
+}
+
+const char* FieldType(ValueType type) {
+	switch (type) {
+		case ValueType::STRING: return "std::string";
+		case ValueType::BOOLEAN: return "bool";
+		case ValueType::INTEGER: return "int64_t";
+		case ValueType::DOUBLE: return "double";
+		case ValueType::LIST: return "std::vector<std::string>";
+		case ValueType::SIZE: return "int64_t";
+		case ValueType::DURATION: return "std::chrono::nanoseconds";
+	}
+	return "";
+}
+
+// The type of a typed Key for a setting. Sizes are read by integer keys.
+const char* KeyType(ValueType type) {
+	switch (type) {
+		case ValueType::STRING: return "std::string_view";
+		case ValueType::BOOLEAN: return "bool";
+		case ValueType::INTEGER: return "int64_t";
+		case ValueType::DOUBLE: return "double";
+		case ValueType::LIST: return "config::ListView";
+		case ValueType::SIZE: return "int64_t";
+		case ValueType::DURATION: return "std::chrono::nanoseconds";
+	}
+	return "";
+}
+
+string DefaultValue(const config::Item& item) {
+	std::ostringstream out;
+	switch (item.GetValueType()) {
+		case ValueType::STRING:
+		out << Quote(item.GetStringView());
+		break;
+
+		case ValueType::BOOLEAN:
+		out << (item.GetBoolean() ? "true" : "false");
+		break;
+
+		case ValueType::INTEGER:
+		// The smallest int64_t cannot be written as a negated literal.
+		if (item.GetInteger() == std::numeric_limits<int64_t>::min()) {
+			out << "std::numeric_limits<int64_t>::min()";
+		} else {
+			out << item.GetInteger();
+		}
+		break;
+
+		case ValueType::DOUBLE:
+		out.precision(std::numeric_limits<double>::max_digits10);
+		out << item.GetDouble();
+		break;
+
+		case ValueType::SIZE:
+		out << item.GetSize();
+		break;
+
+		case ValueType::DURATION:
+		out << "std::chrono::nanoseconds(" << item.GetDuration().count() << ")";
+		break;
+
+		case ValueType::LIST: {
+		out << "{";
+		bool first = true;
+		for (const auto& element : item.GetListView()) {
+			out << (first ? "" : ", ") << Quote(element);
+			first = false;
+		}
+		out << "}";
+		break;
+		}
+	}
+	return out.str();
+}
+
+// The statement that copies an item into a field, returning false on a
+// type mismatch.
+string AssignStatement(const config::Item& item, const string& field) {
+	switch (item.GetValueType()) {
+		case ValueType::STRING:
+		return "if (auto v = item.TryGetString()) { " + field + " = std::string(*v); return true; } return false;";
+		case ValueType::BOOLEAN:
+		return "if (auto v = item.TryGetBoolean()) { " + field + " = *v; return true; } return false;";
+		case ValueType::INTEGER:
+		return "if (auto v = item.TryGetInteger()) { " + field + " = *v; return true; } return false;";
+		case ValueType::DOUBLE:
+		return "if (auto v = item.TryGetDouble()) { " + field + " = *v; return true; } return false;";
+		case ValueType::LIST:
+		return "if (item.GetValueType() != config::ValueType::LIST) { return false; } " + field + " = item.GetList(); return true;";
+		case ValueType::SIZE:
+		return "if (auto v = item.TryGetSize()) { " + field + " = *v; return true; } return false;";
+		case ValueType::DURATION:
+		return "if (auto v = item.TryGetDuration()) { " + field + " = *v; return true; } return false;";
+	}
+	return "return false;";
+}
+
+const std::unordered_set<string> CPP_KEYWORDS = {
+	"alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+	"bool", "break", "case", "catch", "char", "class", "compl", "const",
+	"constexpr", "const_cast", "continue", "decltype", "default", "delete",
+	"do", "double", "dynamic_cast", "else", "enum", "explicit", "export",
+	"extern", "false", "float", "for", "friend", "goto", "if", "inline", "int",
+	"long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+	"nullptr", "operator", "or", "or_eq", "private", "protected", "public",
+	"register", "reinterpret_cast", "return", "short", "signed", "sizeof",
+	"static", "static_assert", "static_cast", "struct", "switch", "template",
+	"this", "thread_local", "throw", "true", "try", "typedef", "typeid",
+	"typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+	"wchar_t", "while", "xor", "xor_eq"
+};
+
+} // namespace
+
+string Codegen::ToIdentifier(const string& in) {
+	string out = "";
+	for (const auto& c : in) {
+		out += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+	}
+	if (out.empty() || std::isdigit(static_cast<unsigned char>(out[0]))) {
+		out = "_" + out;
+	}
+	if (CPP_KEYWORDS.count(out) > 0) {
+		out += "_";
+	}
+	return out;
+}
+
+uint64_t PerfectHash::Slot(const string& key) const {
+	uint64_t bucket = MixHash(HashKey(key, seed)) >> bucketShift;
+	return MixHash(HashKey(key, displacements[bucket])) >> shift;
+}
+
+bool Codegen::FindPerfectHash(const vector<string>& keys, PerfectHash& hash) {
+	// Slots are taken from the top bits of the mixed hash. Tables have at
+	// least two slots and buckets so that shifts stay below 64.
+	uint64_t bits = 1;
+	while ((1ULL << bits) < keys.size()) {
+		bits++;
+	}
+	// Roughly four keys per bucket.
+	uint64_t bucketBits = bits > 3 ? bits - 2 : 1;
+
+	// Seeds are spread with the golden ratio.
+	const uint64_t SPREAD = 0x9E3779B97F4A7C15ULL;
+	const uint64_t maxSeeds = 16;
+	const uint64_t maxDisplacements = 1 << 16;
+
+	for (int doublings = 0; doublings < 2; doublings++, bits++) {
+		for (uint64_t s = 1; s <= maxSeeds; s++) {
+			hash.seed = FNV_OFFSET_BASIS ^ (SPREAD * s);
+			hash.bucketShift = 64 - bucketBits;
+			hash.shift = 64 - bits;
+			hash.displacements.assign(1ULL << bucketBits, 0);
+
+			// Group keys by bucket, and place the largest buckets first while
+			// the table is still empty.
+			vector<vector<const string*>> buckets(1ULL << bucketBits);
+			for (const auto& key : keys) {
+				buckets[MixHash(HashKey(key, hash.seed)) >> hash.bucketShift].push_back(&key);
+			}
+			vector<uint64_t> order(buckets.size());
+			for (uint64_t i = 0; i < order.size(); i++) {
+				order[i] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+				return buckets[a].size() > buckets[b].size();
+			});
+
+			vector<bool> used(1ULL << bits, false);
+			bool placedAll = true;
+			for (const auto& b : order) {
+				if (buckets[b].empty()) {
+					break;
+				}
+				bool placed = false;
+				vector<uint64_t> slots;
+				for (uint64_t d = 1; d <= maxDisplacements && !placed; d++) {
+					uint64_t displacement = hash.seed ^ (SPREAD * (d + maxSeeds));
+					slots.clear();
+					placed = true;
+					for (const auto& key : buckets[b]) {
+						uint64_t slot = MixHash(HashKey(*key, displacement)) >> hash.shift;
+						if (used[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+							placed = false;
+							break;
+						}
+						slots.push_back(slot);
+					}
+					if (placed) {
+						hash.displacements[b] = displacement;
+						for (const auto& slot : slots) {
+							used[slot] = true;
+						}
+					}
+				}
+				if (!placed) {
+					placedAll = false;
+					break;
+				}
+			}
+			if (placedAll) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void Codegen::Generate(const Handler& schema, const string& name, std::ostream& out) {
+	// Group fields by section, sorted so that output is deterministic.
+	std::map<string, vector<Field>> sections;
+	schema.ForEach([&](const string& key, const config::Item& item) {
+		string::size_type pos = key.find(SECTION_DELIM);
+		Field field;
+		field.key = key;
+		field.identifier = ToIdentifier(key.substr(pos + 1));
+		field.item = item;
+		sections[key.substr(0, pos)].push_back(field);
+	});
+
+	vector<string> keys;
+	std::set<string> structNames;
+	std::set<string> sectionIdentifiers;
+	for (auto& kv : sections) {
+		std::sort(kv.second.begin(), kv.second.end(), [](const Field& a, const Field& b) {
+			return a.key < b.key;
+		});
+		std::set<string> fieldIdentifiers;
+		for (const auto& field : kv.second) {
+			if (!fieldIdentifiers.insert(field.identifier).second) {
+				throw std::runtime_error(errors::CODEGEN_IDENTIFIER);
+			}
+			keys.push_back(field.key);
+		}
+		string identifier = ToIdentifier(kv.first);
+		if (!sectionIdentifiers.insert(identifier).second ||
+				!structNames.insert(ToStructName(identifier)).second) {
+			throw std::runtime_error(errors::CODEGEN_IDENTIFIER);
+		}
+	}
+
+	// Handler::Get(Key) tells keys apart by name, but a generated key that
+	// shares its hash with another setting would always take the slow path.
+	std::set<uint64_t> keyHashes;
+	for (const auto& key : keys) {
+		if (!keyHashes.insert(HashKey(key)).second) {
+			throw std::runtime_error(errors::CODEGEN_KEY_HASH);
+		}
+	}
+
+	PerfectHash hash;
+	if (!FindPerfectHash(keys, hash)) {
+		throw std::runtime_error(errors::CODEGEN_PERFECT_HASH);
+	}
+
+	out << "// Generated by config_parser codegen from " << name << ". Do not edit.\n\n";
+	out << "#ifndef CONFIG_GEN_H_\n#define CONFIG_GEN_H_\n\n";
+	out << "#include <chrono>\n#include <cstdint>\n#include <limits>\n#include <string>\n#include <string_view>\n#include <vector>\n\n";
+	out << "#include \"config/handler.h\"\n\n";
+	out << "namespace config_gen {\n\n";
+
+	// One struct per section, one field per setting.
+	out << "struct Config {\n";
+	for (const auto& kv : sections) {
+		string identifier = ToIdentifier(kv.first);
+		out << "\tstruct " << ToStructName(identifier) << " {\n";
+		for (const auto& field : kv.second) {
+			out << "\t\t" << FieldType(field.item.GetValueType()) << " " << field.identifier
+				<< " = " << DefaultValue(field.item) << ";\n";
+		}
+		out << "\t} " << identifier << ";\n";
+	}
+	out << "};\n\n";
+
+	// Typed keys for Handler::Get, so that reading a setting as the wrong type
+	// fails to compile.
+	out << "namespace keys {\n\n";
+	for (const auto& kv : sections) {
+		out << "namespace " << ToIdentifier(kv.first) << " {\n";
+		for (const auto& field : kv.second) {
+			out << "constexpr config::Key<" << KeyType(field.item.GetValueType()) << "> " << field.identifier
+				<< "(" << Quote(field.key) << ");\n";
+		}
+		out << "} // namespace " << ToIdentifier(kv.first) << "\n\n";
+	}
+	out << "} // namespace keys\n\n";
+
+	// Perfect-hash dispatch: every schema key lands in its own slot, so a
+	// single string compare confirms the match.
+	out << "// Copy a single setting into its field. Unknown keys are ignored.\n";
+	out << "// Returns false if a known key holds a value of the wrong type.\n";
+	out << "inline bool Assign(Config& cfg, const std::string& key, const config::Item& item) {\n";
+	out << "\tstatic const uint64_t DISPLACEMENTS[" << hash.displacements.size() << "] = {";
+	for (uint64_t i = 0; i < hash.displacements.size(); i++) {
+		out << (i % 4 == 0 ? "\n\t\t" : " ") << hash.displacements[i] << "ULL,";
+	}
+	out << "\n\t};\n";
+	out << "\tuint64_t bucket = config::MixHash(config::HashKey(key, " << hash.seed << "ULL)) >> " << hash.bucketShift << ";\n";
+	out << "\tswitch (config::MixHash(config::HashKey(key, DISPLACEMENTS[bucket])) >> " << hash.shift << ") {\n";
+	std::map<uint64_t, std::pair<string, string>> cases;
+	for (const auto& kv : sections) {
+		for (const auto& field : kv.second) {
+			string target = "cfg." + ToIdentifier(kv.first) + "." + field.identifier;
+			cases[hash.Slot(field.key)] =
+				std::make_pair(field.key, AssignStatement(field.item, target));
+		}
+	}
+	for (const auto& c : cases) {
+		out << "\t\tcase " << c.first << ":\n";
+		out << "\t\t\tif (key != " << Quote(c.second.first) << ") { return true; }\n";
+		out << "\t\t\t" << c.second.second << "\n";
+	}
+	out << "\t\tdefault:\n\t\t\treturn true;\n";
+	out << "\t}\n}\n\n";
+
+	out << "// Fill the struct from a loaded handler in a single pass over its settings.\n";
+	out << "// Fields missing from the config keep their schema defaults.\n";
+	out << "inline bool Load(const config::Handler& handler, Config& cfg) {\n";
+	out << "\tbool ok = true;\n";
+	out << "\thandler.ForEach([&](const std::string& key, const config::Item& item) {\n";
+	out << "\t\tok = Assign(cfg, key, item) && ok;\n";
+	out << "\t});\n";
+	out << "\treturn ok;\n";
+	out << "}\n\n";
+
+	out << "} // namespace config_gen\n\n";
+	out << "#endif // CONFIG_GEN_H_\n";
+}
+
+} // namespace config
@@ -0,0 +1,58 @@
+/*
+ * A Codegen object turns a loaded schema config into a C++ header with one
+ * typed struct field per setting, and a loader that fills the struct from a
+ * Handler using a perfect-hash dispatch on "section.key". It also declares a
+ * typed Key per setting, so that reading a setting as the wrong type through
+ * Handler::Get does not compile.
+ */
+
+#ifndef CONFIG_CODEGEN_H_
+#define CONFIG_CODEGEN_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "handler.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+// A two-level (hash-and-displace) perfect hash. A key is first hashed into a
+// bucket, and each bucket has its own seed chosen so that every key lands in
+// a distinct slot of a power-of-two table.
+struct PerfectHash {
+	public:
+		uint64_t seed;
+		uint64_t bucketShift;
+		uint64_t shift;
+		vector<uint64_t> displacements;
+
+		// The slot of a key. Only meaningful for the keys the hash was built for.
+		uint64_t Slot(const string&) const;
+};
+
+class Codegen {
+	public:
+		// Write a header for every setting loaded in the schema handler. The
+		// schema's values become the default value of each field. The name is
+		// only used in the header's comment. Throws on settings whose names
+		// cannot be turned into unique C++ identifiers or typed key hashes.
+		void Generate(const Handler&, const string&, std::ostream&);
+
+		// Build a perfect hash over a set of distinct keys into a table of at
+		// most twice the number of keys. Returns false if none was found (only
+		// expected for duplicate keys).
+		bool FindPerfectHash(const vector<string>&, PerfectHash&);
+
+		// Turn an arbitrary section or key name into a valid C++ identifier.
+		string ToIdentifier(const string&);
+};
+
+} // namespace config
+
+#endif // CONFIG_CODEGEN_H_
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "../common/lest.hpp"
+#include "codegen.h"
+
+const lest::test specification[] = {
+	CASE("ToIdentifier produces valid C++ identifiers") {
+		config::Codegen codegen;
+
+		EXPECT(codegen.ToIdentifier("paid_users_size_limit") == "paid_users_size_limit");
+		EXPECT(codegen.ToIdentifier("http-common_123") == "http_common_123");
+		EXPECT(codegen.ToIdentifier("123abc") == "_123abc");
+		EXPECT(codegen.ToIdentifier("default") == "default_");
+		EXPECT(codegen.ToIdentifier("") == "_");
+	},
+
+	CASE("FindPerfectHash maps every key to its own slot") {
+		config::Codegen codegen;
+		std::vector<std::string> keys;
+		for (int i = 0; i < 500; i++) {
+			keys.push_back("section" + std::to_string(i % 7) + ".key" + std::to_string(i));
+		}
+
+		config::PerfectHash hash;
+		EXPECT(codegen.FindPerfectHash(keys, hash) == true);
+
+		std::set<uint64_t> slots;
+		for (const auto& key : keys) {
+			slots.insert(hash.Slot(key));
+		}
+		EXPECT(slots.size() == keys.size());
+		EXPECT((1ULL << (64 - hash.shift)) <= 2 * 512u);
+	},
+
+	CASE("Generate emits one typed field per setting") {
+		config::Handler schema;
+		EXPECT(schema.Load("sample.ini", {}) == true);
+
+		config::Codegen codegen;
+		std::ostringstream out;
+		codegen.Generate(schema, "sample.ini", out);
+		std::string header = out.str();
+
+		EXPECT(header.find("struct CommonSection {") != std::string::npos);
+		EXPECT(header.find("int64_t paid_users_size_limit = 2147483648;") != std::string::npos);
+		EXPECT(header.find("bool enabled = false;") != std::string::npos);
+		EXPECT(header.find("std::vector<std::string> params = {\"array\", \"of\", \"values\"};") != std::string::npos);
+		EXPECT(header.find("if (key != \"ftp.path\")") != std::string::npos);
+		EXPECT(header.find("constexpr config::Key<std::string_view> path(\"ftp.path\");") != std::string::npos);
+		EXPECT(header.find("constexpr config::Key<bool> enabled(\"ftp.enabled\");") != std::string::npos);
+	},
+
+	CASE("Generate emits integer keys for sizes") {
+		config::Handler schema;
+		EXPECT(schema.Load("sample.ini", {}) == true);
+		config::Item limit;
+		limit.SetSize(int64_t(25) << 20);
+		schema.Set("ftp.limit", limit);
+
+		config::Codegen codegen;
+		std::ostringstream out;
+		codegen.Generate(schema, "sample.ini", out);
+		std::string header = out.str();
+
+		EXPECT(header.find("int64_t limit = 26214400;") != std::string::npos);
+		EXPECT(header.find("constexpr config::Key<int64_t> limit(\"ftp.limit\");") != std::string::npos);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -0,0 +1,546 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "errors.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+namespace {
+
+// Frame header: a u32 body length and a u8 opcode or status.
+const size_t HEADER_SIZE = 5;
+
+// Bytes read from a socket at a time.
+const size_t READ_CHUNK = 64 * 1024;
+
+void PutU8(string& out, uint8_t value) {
+	out.push_back(static_cast<char>(value));
+}
+
+void PutU16(string& out, uint16_t value) {
+	out.push_back(static_cast<char>(value));
+	out.push_back(static_cast<char>(value >> 8));
+}
+
+void PutU32(string& out, uint32_t value) {
+	for (int shift = 0; shift < 32; shift += 8) {
+		out.push_back(static_cast<char>(value >> shift));
+	}
+}
+
+void PutU64(string& out, uint64_t value) {
+	for (int shift = 0; shift < 64; shift += 8) {
+		out.push_back(static_cast<char>(value >> shift));
+	}
+}
+
+uint64_t GetLittleEndian(const char* data, size_t size) {
+	uint64_t value = 0;
+	for (size_t i = 0; i < size; i++) {
+		value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+	}
+	return value;
+}
+
+// Reads fields from a frame body, failing once any read runs past its end.
+class BodyReader {
+  private:
+	std::string_view body;
+	size_t offset = 0;
+	bool failed = false;
+
+	const char* Take(size_t size) {
+		if (failed || body.size() - offset < size) {
+			failed = true;
+			return NULL;
+		}
+		const char* data = body.data() + offset;
+		offset += size;
+		return data;
+	}
+
+	uint64_t Integer(size_t size) {
+		const char* data = Take(size);
+		return data == NULL ? 0 : GetLittleEndian(data, size);
+	}
+
+  public:
+	explicit BodyReader(std::string_view body) : body(body) {}
+
+	uint8_t U8() { return static_cast<uint8_t>(Integer(1)); }
+	uint16_t U16() { return static_cast<uint16_t>(Integer(2)); }
+	uint32_t U32() { return static_cast<uint32_t>(Integer(4)); }
+	uint64_t U64() { return Integer(8); }
+
+	std::string_view Bytes(size_t size) {
+		const char* data = Take(size);
+		return data == NULL ? std::string_view() : std::string_view(data, size);
+	}
+
+	// True if every read succeeded and the whole body was read.
+	bool Done() const {
+		return !failed && offset == body.size();
+	}
+
+	bool Failed() const {
+		return failed;
+	}
+};
+
+// Append a frame, leaving room to fill in its body length afterwards.
+size_t BeginFrame(string& out, uint8_t code) {
+	size_t start = out.size();
+	PutU32(out, 0);
+	PutU8(out, code);
+	return start;
+}
+
+void EndFrame(string& out, size_t start) {
+	uint32_t length = static_cast<uint32_t>(out.size() - start - HEADER_SIZE);
+	for (int i = 0; i < 4; i++) {
+		out[start + i] = static_cast<char>(length >> (8 * i));
+	}
+}
+
+void PutItem(string& out, const config::Item* item) {
+	if (item == NULL) {
+		PutU8(out, 0);
+		return;
+	}
+	PutU8(out, static_cast<uint8_t>(1 + item->GetValueType()));
+	switch (item->GetValueType()) {
+		case ValueType::STRING: {
+			std::string_view value = item->GetStringView();
+			PutU32(out, static_cast<uint32_t>(value.size()));
+			out.append(value);
+			break;
+		}
+		case ValueType::BOOLEAN:
+			PutU8(out, item->GetBoolean() ? 1 : 0);
+			break;
+		case ValueType::INTEGER:
+			PutU64(out, static_cast<uint64_t>(item->GetInteger()));
+			break;
+		case ValueType::SIZE:
+			PutU64(out, static_cast<uint64_t>(item->GetSize()));
+			break;
+		case ValueType::DURATION:
+			PutU64(out, static_cast<uint64_t>(item->GetDuration().count()));
+			break;
+		case ValueType::DOUBLE: {
+			double value = item->GetDouble();
+			uint64_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			PutU64(out, bits);
+			break;
+		}
+		case ValueType::LIST: {
+			ListView list = item->GetListView();
+			PutU32(out, static_cast<uint32_t>(list.size()));
+			for (std::string_view element : list) {
+				PutU32(out, static_cast<uint32_t>(element.size()));
+				out.append(element);
+			}
+			break;
+		}
+	}
+}
+
+} // namespace
+
+ConfigDaemon::ConfigDaemon(const string& filename, const vector<string>& overrides, const string& socketPath)
+	: filename(filename),
+	  overrides(overrides),
+	  socketPath(socketPath),
+	  listenFd(-1),
+	  epollFd(-1),
+	  wakeFd(-1),
+	  stopping(false) {}
+
+ConfigDaemon::~ConfigDaemon() {
+	for (const auto& connection : connections) {
+		close(connection.first);
+	}
+	if (listenFd >= 0) {
+		close(listenFd);
+		unlink(socketPath.c_str());
+	}
+	if (epollFd >= 0) {
+		close(epollFd);
+	}
+	if (wakeFd >= 0) {
+		close(wakeFd);
+	}
+}
+
+void ConfigDaemon::Start() {
+	if (handler.Reload(filename, overrides, context) == INVALID) {
+		throw std::runtime_error(errors::DAEMON_INVALID);
+	}
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error(errors::DAEMON_SOCKET);
+	}
+	std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (listenFd < 0 || epollFd < 0 || wakeFd < 0) {
+		throw std::runtime_error(errors::DAEMON_SOCKET);
+	}
+	unlink(socketPath.c_str());
+	if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+		|| listen(listenFd, SOMAXCONN) != 0) {
+		close(listenFd);
+		listenFd = -1;
+		throw std::runtime_error(errors::DAEMON_SOCKET);
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = listenFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+	event.data.fd = wakeFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+void ConfigDaemon::Run() {
+	epoll_event events[64];
+	while (!stopping) {
+		int count = epoll_wait(epollFd, events, 64, -1);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		for (int i = 0; i < count; i++) {
+			int fd = events[i].data.fd;
+			if (fd == wakeFd) {
+				continue;
+			}
+			if (fd == listenFd) {
+				Accept();
+				continue;
+			}
+			auto it = connections.find(fd);
+			if (it == connections.end()) {
+				continue;
+			}
+			Connection& connection = it->second;
+			bool open = true;
+			if (events[i].events & EPOLLOUT) {
+				open = Flush(fd, connection);
+			} else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				// Answer what was received even if the client hung up.
+				open = Receive(fd, connection);
+				open = Flush(fd, connection) && open;
+			}
+			if (open) {
+				Rearm(fd, connection);
+			} else {
+				Disconnect(fd);
+			}
+		}
+	}
+}
+
+void ConfigDaemon::Stop() {
+	stopping = true;
+	if (wakeFd >= 0) {
+		uint64_t one = 1;
+		ssize_t written = write(wakeFd, &one, sizeof(one));
+		(void)written;
+	}
+}
+
+void ConfigDaemon::Accept() {
+	while (true) {
+		int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			close(fd);
+			continue;
+		}
+		connections[fd];
+	}
+}
+
+bool ConfigDaemon::Receive(int fd, Connection& connection) {
+	// Read everything available, so that a pipelined batch of requests is
+	// answered with one write, but no more than a whole frame at a time.
+	bool closed = false;
+	while (connection.in.size() < MAX_FRAME + HEADER_SIZE) {
+		size_t size = connection.in.size();
+		connection.in.resize(size + READ_CHUNK);
+		ssize_t received = read(fd, &connection.in[size], READ_CHUNK);
+		connection.in.resize(size + (received > 0 ? received : 0));
+		if (received > 0) {
+			continue;
+		}
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		closed = received == 0 || errno != EAGAIN;
+		break;
+	}
+
+	size_t offset = 0;
+	while (connection.in.size() - offset >= HEADER_SIZE) {
+		const char* header = connection.in.data() + offset;
+		uint32_t length = static_cast<uint32_t>(GetLittleEndian(header, 4));
+		if (length > MAX_FRAME) {
+			size_t start = BeginFrame(connection.out, static_cast<uint8_t>(DaemonStatus::BAD_REQUEST));
+			EndFrame(connection.out, start);
+			Flush(fd, connection);
+			return false;
+		}
+		if (connection.in.size() - offset - HEADER_SIZE < length) {
+			break;
+		}
+		DaemonOp op = static_cast<DaemonOp>(header[4]);
+		std::string_view body(header + HEADER_SIZE, length);
+		offset += HEADER_SIZE + length;
+		if (!Serve(op, body, connection.out)) {
+			Flush(fd, connection);
+			return false;
+		}
+	}
+	connection.in.erase(0, offset);
+	return !closed;
+}
+
+bool ConfigDaemon::Serve(DaemonOp op, std::string_view body, string& out) {
+	BodyReader reader(body);
+	size_t start = out.size();
+	switch (op) {
+		case DaemonOp::LOOKUP: {
+			BeginFrame(out, static_cast<uint8_t>(DaemonStatus::OK));
+			uint16_t count = reader.U16();
+			PutU16(out, count);
+			for (uint16_t i = 0; i < count && !reader.Failed(); i++) {
+				std::string_view key = reader.Bytes(reader.U16());
+				PutItem(out, handler.Find(key));
+			}
+			break;
+		}
+		case DaemonOp::RELOAD: {
+			ReloadStatus status;
+			try {
+				status = handler.Reload(filename, overrides, context);
+			} catch (std::exception& e) {
+				// The file is gone or unreadable; keep serving the last load.
+				BeginFrame(out, static_cast<uint8_t>(DaemonStatus::FAILED));
+				EndFrame(out, start);
+				return true;
+			}
+			BeginFrame(out, static_cast<uint8_t>(DaemonStatus::OK));
+			PutU8(out, static_cast<uint8_t>(status));
+			break;
+		}
+		default:
+			reader.Bytes(body.size() + 1);
+			break;
+	}
+	if (!reader.Done()) {
+		out.resize(start);
+		BeginFrame(out, static_cast<uint8_t>(DaemonStatus::BAD_REQUEST));
+		EndFrame(out, start);
+		return false;
+	}
+	EndFrame(out, start);
+	return true;
+}
+
+bool ConfigDaemon::Flush(int fd, Connection& connection) {
+	while (connection.written < connection.out.size()) {
+		ssize_t written = send(fd, connection.out.data() + connection.written,
+			connection.out.size() - connection.written, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno == EAGAIN;
+		}
+		connection.written += written;
+	}
+	connection.out.clear();
+	connection.written = 0;
+	return true;
+}
+
+void ConfigDaemon::Rearm(int fd, const Connection& connection) {
+	epoll_event event = {};
+	event.events = connection.out.empty() ? EPOLLIN : EPOLLOUT;
+	event.data.fd = fd;
+	epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+void ConfigDaemon::Disconnect(int fd) {
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+	close(fd);
+	connections.erase(fd);
+}
+
+DaemonClient::DaemonClient(const string& socketPath) : fd(-1) {
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error(errors::DAEMON_SOCKET);
+	}
+	std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		throw std::runtime_error(errors::DAEMON_SOCKET);
+	}
+}
+
+DaemonClient::~DaemonClient() {
+	close(fd);
+}
+
+void DaemonClient::Send(DaemonOp op, std::string_view body) {
+	string frame;
+	PutU32(frame, static_cast<uint32_t>(body.size()));
+	PutU8(frame, static_cast<uint8_t>(op));
+	frame.append(body);
+	size_t offset = 0;
+	while (offset < frame.size()) {
+		ssize_t written = send(fd, frame.data() + offset, frame.size() - offset, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::runtime_error(errors::DAEMON_SOCKET);
+		}
+		offset += written;
+	}
+}
+
+string DaemonClient::Receive() {
+	while (true) {
+		if (in.size() >= HEADER_SIZE) {
+			uint32_t length = static_cast<uint32_t>(GetLittleEndian(in.data(), 4));
+			if (in.size() - HEADER_SIZE >= length) {
+				DaemonStatus status = static_cast<DaemonStatus>(in[4]);
+				string body = in.substr(HEADER_SIZE, length);
+				in.erase(0, HEADER_SIZE + length);
+				if (status != DaemonStatus::OK) {
+					throw std::runtime_error(errors::DAEMON_RESPONSE);
+				}
+				return body;
+			}
+		}
+		char buffer[READ_CHUNK];
+		ssize_t received = read(fd, buffer, sizeof(buffer));
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		if (received <= 0) {
+			throw std::runtime_error(errors::DAEMON_SOCKET);
+		}
+		in.append(buffer, received);
+	}
+}
+
+vector<std::optional<config::Item>> DaemonClient::Lookup(const vector<string>& keys) {
+	if (keys.size() > UINT16_MAX) {
+		throw std::runtime_error(errors::DAEMON_REQUEST);
+	}
+	string body;
+	PutU16(body, static_cast<uint16_t>(keys.size()));
+	for (const auto& key : keys) {
+		if (key.size() > UINT16_MAX) {
+			throw std::runtime_error(errors::DAEMON_REQUEST);
+		}
+		PutU16(body, static_cast<uint16_t>(key.size()));
+		body.append(key);
+	}
+	Send(DaemonOp::LOOKUP, body);
+
+	string response = Receive();
+	BodyReader reader(response);
+	vector<std::optional<config::Item>> out(reader.U16());
+	for (auto& value : out) {
+		uint8_t tag = reader.U8();
+		if (tag == 0) {
+			continue;
+		}
+		config::Item item;
+		switch (static_cast<ValueType>(tag - 1)) {
+			case ValueType::STRING:
+				item.SetString(string(reader.Bytes(reader.U32())));
+				break;
+			case ValueType::BOOLEAN:
+				item.SetBoolean(reader.U8() != 0);
+				break;
+			case ValueType::INTEGER:
+				item.SetInteger(static_cast<int64_t>(reader.U64()));
+				break;
+			case ValueType::SIZE:
+				item.SetSize(static_cast<int64_t>(reader.U64()));
+				break;
+			case ValueType::DURATION:
+				item.SetDuration(std::chrono::nanoseconds(static_cast<int64_t>(reader.U64())));
+				break;
+			case ValueType::DOUBLE: {
+				uint64_t bits = reader.U64();
+				double number;
+				std::memcpy(&number, &bits, sizeof(number));
+				item.SetDouble(number);
+				break;
+			}
+			case ValueType::LIST: {
+				vector<string> list(reader.U32());
+				for (auto& element : list) {
+					element = string(reader.Bytes(reader.U32()));
+				}
+				item.SetList(list);
+				break;
+			}
+			default:
+				throw std::runtime_error(errors::DAEMON_RESPONSE);
+		}
+		value = item;
+	}
+	if (!reader.Done() || out.size() != keys.size()) {
+		throw std::runtime_error(errors::DAEMON_RESPONSE);
+	}
+	return out;
+}
+
+ReloadStatus DaemonClient::Reload() {
+	Send(DaemonOp::RELOAD, {});
+	string response = Receive();
+	BodyReader reader(response);
+	uint8_t status = reader.U8();
+	if (!reader.Done() || status > INVALID) {
+		throw std::runtime_error(errors::DAEMON_RESPONSE);
+	}
+	return static_cast<ReloadStatus>(status);
+}
+
+} // namespace config
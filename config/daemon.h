@@ -0,0 +1,162 @@
+/*
+ * A ConfigDaemon object keeps a config file loaded and answers lookups from
+ * other processes over a Unix domain socket. A DaemonClient object speaks
+ * its protocol.
+ *
+ * Every message is a frame: a 4-byte body length, a 1-byte opcode (requests)
+ * or status (responses), and the body. Integers are little-endian. Clients
+ * may pipeline any number of requests; responses come back in order.
+ *
+ *   LOOKUP request:   u16 count, then count times { u16 length, key bytes }
+ *   LOOKUP response:  u16 count, then count values, in request order:
+ *                     u8 tag (0 = missing, 1 + ValueType otherwise), then
+ *                     STRING   u32 length, bytes
+ *                     BOOLEAN  u8
+ *                     INTEGER  i64
+ *                     DOUBLE   8 bytes, IEEE 754
+ *                     LIST     u32 count, then count times { u32 length, bytes }
+ *                     SIZE     i64 bytes
+ *                     DURATION i64 nanoseconds
+ *   RELOAD request:   empty body
+ *   RELOAD response:  u8 ReloadStatus
+ *
+ * A malformed request gets a BAD_REQUEST response with an empty body, and
+ * the connection is closed.
+ */
+
+#ifndef CONFIG_DAEMON_H_
+#define CONFIG_DAEMON_H_
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "handler.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// Request opcodes.
+enum class DaemonOp : uint8_t {
+	LOOKUP = 1,
+	RELOAD = 2
+};
+
+// Response statuses.
+enum class DaemonStatus : uint8_t {
+	OK = 0,
+	BAD_REQUEST = 1,
+	// The request was valid, but could not be served, e.g. a reload of a
+	// file that no longer exists.
+	FAILED = 2
+};
+
+class ConfigDaemon {
+  private:
+	const string filename;
+	const vector<string> overrides;
+	const string socketPath;
+
+	// Only the event loop thread touches these, so lookups need no locks.
+	Handler handler;
+	LoadContext context;
+
+	// Buffered bytes of one client connection.
+	struct Connection {
+		string in;
+		string out;
+		size_t written = 0;
+	};
+	unordered_map<int, Connection> connections;
+
+	int listenFd;
+	int epollFd;
+	int wakeFd;
+	std::atomic<bool> stopping;
+
+	// Accept every pending connection.
+	void Accept();
+
+	// Read what a client sent, and answer each complete request. Returns
+	// false if the connection should be closed.
+	bool Receive(int, Connection&);
+
+	// Write as much of a connection's pending output as the socket takes.
+	// Returns false if the connection should be closed.
+	bool Flush(int, Connection&);
+
+	// Watch a connection for input when its output is drained, and only for
+	// output otherwise, so that a client that does not read its responses
+	// cannot make the daemon buffer without bound.
+	void Rearm(int, const Connection&);
+
+	void Disconnect(int);
+
+	// Answer one request, appending the response to the output. Returns
+	// false if the request was malformed.
+	bool Serve(DaemonOp, std::string_view, string&);
+
+  public:
+	// Requests larger than this are rejected.
+	static constexpr uint32_t MAX_FRAME = 1 << 20;
+
+	ConfigDaemon(const string&, const vector<string>&, const string&);
+
+	// Closes every connection and removes the socket.
+	~ConfigDaemon();
+
+	ConfigDaemon(const ConfigDaemon&) = delete;
+	ConfigDaemon& operator=(const ConfigDaemon&) = delete;
+
+	// Load the file and start listening on the socket, replacing a stale
+	// socket file left by an earlier daemon. Throws if the file cannot be
+	// opened, contains an invalid setting, or the socket cannot be bound.
+	void Start();
+
+	// Serve clients until Stop() is called. Must be called after Start().
+	void Run();
+
+	// Make Run() return. Safe to call from any thread, and from a signal
+	// handler.
+	void Stop();
+};
+
+// A blocking client for a ConfigDaemon. Not thread-safe.
+class DaemonClient {
+  private:
+	int fd;
+	string in;
+
+	// Send one request frame.
+	void Send(DaemonOp, std::string_view);
+
+	// Receive one response frame. Throws if it is not OK.
+	string Receive();
+
+  public:
+	// Connect to a daemon's socket. Throws if it cannot.
+	explicit DaemonClient(const string&);
+	~DaemonClient();
+
+	DaemonClient(const DaemonClient&) = delete;
+	DaemonClient& operator=(const DaemonClient&) = delete;
+
+	// Look up several "section.key" settings in one round trip. Missing
+	// settings are empty. Throws on connection or protocol errors, and if
+	// there are more than 65535 keys or a key is longer than 65535 bytes.
+	vector<std::optional<config::Item>> Lookup(const vector<string>&);
+
+	// Make the daemon reload its file.
+	ReloadStatus Reload();
+};
+
+} // namespace config
+
+#endif // CONFIG_DAEMON_H_
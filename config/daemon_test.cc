@@ -0,0 +1,156 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "../common/lest.hpp"
+#include "daemon.h"
+
+// Replace the contents of a file in place.
+void WriteFile(const std::string& filename, const std::string& contents) {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	file << contents;
+}
+
+std::string TemporaryFile(const std::string& name) {
+	return (std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_" + name)).string();
+}
+
+// Connect to a socket without a DaemonClient, to send hand-made frames.
+int Connect(const std::string& path) {
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	path.copy(address.sun_path, path.size());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+	return fd;
+}
+
+// Read until the peer closes the connection.
+std::string ReadAll(int fd) {
+	std::string out;
+	char buffer[4096];
+	ssize_t received;
+	while ((received = read(fd, buffer, sizeof(buffer))) > 0) {
+		out.append(buffer, received);
+	}
+	return out;
+}
+
+// A LOOKUP frame for a single key.
+std::string LookupFrame(const std::string& key) {
+	std::string body;
+	body += static_cast<char>(1);
+	body += static_cast<char>(0);
+	body += static_cast<char>(key.size());
+	body += static_cast<char>(0);
+	body += key;
+	std::string frame;
+	for (int i = 0; i < 4; i++) {
+		frame += static_cast<char>(body.size() >> (8 * i));
+	}
+	frame += static_cast<char>(config::DaemonOp::LOOKUP);
+	return frame + body;
+}
+
+const lest::test specification[] = {
+	CASE("A daemon answers batched lookups and reloads") {
+		std::string filename = TemporaryFile("config_daemon_test.ini");
+		std::string socketPath = TemporaryFile("config_daemon_test.sock");
+		WriteFile(filename, "[ftp]\npath=/a\nport=21\nratio=0.5\nsecure=yes\nusers=a,b,c\nlimit=25MiB\ntimeout=500ms\n");
+
+		config::ConfigDaemon daemon(filename, {}, socketPath);
+		daemon.Start();
+		std::thread loop(&config::ConfigDaemon::Run, &daemon);
+
+		{
+			config::DaemonClient client(socketPath);
+			auto values = client.Lookup({"ftp.path", "ftp.port", "ftp.ratio", "ftp.secure", "ftp.users", "ftp.missing"});
+			EXPECT(values.size() == 6u);
+			EXPECT(values[0]->GetString() == "/a");
+			EXPECT(values[1]->GetInteger() == 21);
+			EXPECT(values[2]->GetDouble() == 0.5);
+			EXPECT(values[3]->GetBoolean() == true);
+			EXPECT(values[4]->GetList() == std::vector<std::string>({"a", "b", "c"}));
+			EXPECT(values[5].has_value() == false);
+			EXPECT(client.Lookup({}).empty());
+			values = client.Lookup({"ftp.limit", "ftp.timeout"});
+			EXPECT(values[0]->GetSize() == 25 * 1024 * 1024);
+			EXPECT(values[1]->GetDuration() == std::chrono::milliseconds(500));
+
+			EXPECT(client.Reload() == config::UNCHANGED);
+			WriteFile(filename, "[ftp]\npath=/b\n");
+			EXPECT(client.Reload() == config::RELOADED);
+			EXPECT(client.Lookup({"ftp.path"})[0]->GetString() == "/b");
+			EXPECT(client.Lookup({"ftp.port"})[0].has_value() == false);
+
+			// Invalid and missing files keep the last good settings
+			WriteFile(filename, "[ftp]\npath=/c\nnot a setting\n");
+			EXPECT(client.Reload() == config::INVALID);
+			std::filesystem::remove(filename);
+			EXPECT_THROWS_AS(client.Reload(), std::runtime_error);
+			EXPECT(client.Lookup({"ftp.path"})[0]->GetString() == "/b");
+		}
+
+		// Pipelined requests in one write are answered in order
+		{
+			int fd = Connect(socketPath);
+			std::string frames;
+			for (int i = 0; i < 100; i++) {
+				frames += LookupFrame(i % 2 == 0 ? "ftp.path" : "ftp.none");
+			}
+			EXPECT(write(fd, frames.data(), frames.size()) == static_cast<ssize_t>(frames.size()));
+			shutdown(fd, SHUT_WR);
+			std::string responses = ReadAll(fd);
+			close(fd);
+			// OK frames of { u16 count, tag, u32 length, "/b" } and { u16 count, tag }
+			std::string found = std::string("\x09\0\0\0\0\x01\0\x01\x02\0\0\0/b", 14);
+			std::string missing = std::string("\x03\0\0\0\0\x01\0\0", 8);
+			std::string expected;
+			for (int i = 0; i < 100; i++) {
+				expected += i % 2 == 0 ? found : missing;
+			}
+			EXPECT(responses == expected);
+		}
+
+		// Malformed requests are rejected and the connection closed
+		{
+			int fd = Connect(socketPath);
+			std::string truncated = LookupFrame("ftp.path");
+			truncated[0] = static_cast<char>(truncated[0] - 1);
+			truncated.pop_back();
+			EXPECT(write(fd, truncated.data(), truncated.size()) == static_cast<ssize_t>(truncated.size()));
+			EXPECT(ReadAll(fd) == std::string("\0\0\0\0\x01", 5));
+			close(fd);
+
+			fd = Connect(socketPath);
+			std::string oversized = std::string("\xff\xff\xff\x7f\x01", 5);
+			EXPECT(write(fd, oversized.data(), oversized.size()) == 5);
+			EXPECT(ReadAll(fd) == std::string("\0\0\0\0\x01", 5));
+			close(fd);
+		}
+
+		daemon.Stop();
+		loop.join();
+	},
+
+	CASE("A daemon refuses to start on an invalid file") {
+		std::string filename = TemporaryFile("config_daemon_invalid.ini");
+		WriteFile(filename, "[ftp]\nnot a setting\n");
+		config::ConfigDaemon daemon(filename, {}, TemporaryFile("config_daemon_invalid.sock"));
+		EXPECT_THROWS_AS(daemon.Start(), std::runtime_error);
+		std::filesystem::remove(filename);
+
+		EXPECT_THROWS_AS(config::DaemonClient{TemporaryFile("config_daemon_none.sock")}, std::runtime_error);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+
+#include "diff.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+bool ConfigDiff::Empty() const {
+	return added.empty() && removed.empty() && changed.empty();
+}
+
+ConfigDiff Diff(const Handler& before, const Handler& after) {
+	ConfigDiff diff;
+
+	// Sections that exist after the change. Usually most of them are
+	// identical, and cost a lookup each, without building their names.
+	for (const auto& section : after.sectionHashes) {
+		std::string_view sectionName = after.names.Name(section.first);
+		uint32_t beforeId = before.names.Find(sectionName);
+		bool existed = false;
+		if (beforeId != Interner::NOT_FOUND) {
+			auto previous = before.sectionHashes.find(beforeId);
+			if (previous != before.sectionHashes.end()) {
+				if (previous->second == section.second) {
+					// Identical section.
+					continue;
+				}
+				existed = true;
+			}
+		}
+
+		string name(sectionName);
+		const unordered_map<string, config::Item>* beforeItems = existed ? &before.settingsSection.at(name) : NULL;
+		const unordered_map<string, config::Item>& afterItems = after.settingsSection.at(name);
+		for (const auto& kv : afterItems) {
+			if (beforeItems == NULL) {
+				diff.added.push_back(name + SECTION_DELIM + kv.first);
+				continue;
+			}
+			auto it = beforeItems->find(kv.first);
+			if (it == beforeItems->end()) {
+				diff.added.push_back(name + SECTION_DELIM + kv.first);
+			} else if (it->second.Hash() != kv.second.Hash()) {
+				diff.changed.push_back(name + SECTION_DELIM + kv.first);
+			}
+		}
+		if (beforeItems != NULL) {
+			for (const auto& kv : *beforeItems) {
+				if (afterItems.count(kv.first) == 0) {
+					diff.removed.push_back(name + SECTION_DELIM + kv.first);
+				}
+			}
+		}
+	}
+
+	// Sections that no longer exist.
+	for (const auto& section : before.sectionHashes) {
+		std::string_view sectionName = before.names.Name(section.first);
+		uint32_t afterId = after.names.Find(sectionName);
+		if (afterId != Interner::NOT_FOUND && after.sectionHashes.count(afterId) > 0) {
+			continue;
+		}
+		string name(sectionName);
+		for (const auto& kv : before.settingsSection.at(name)) {
+			diff.removed.push_back(name + SECTION_DELIM + kv.first);
+		}
+	}
+
+	std::sort(diff.added.begin(), diff.added.end());
+	std::sort(diff.removed.begin(), diff.removed.end());
+	std::sort(diff.changed.begin(), diff.changed.end());
+	return diff;
+}
+
+} // namespace config
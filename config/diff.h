@@ -0,0 +1,39 @@
+/*
+ * Diff compares two loaded configs, e.g. two snapshots published by a
+ * ConfigWatcher, and reports which settings were added, removed or changed.
+ */
+
+#ifndef CONFIG_DIFF_H_
+#define CONFIG_DIFF_H_
+
+#include <string>
+#include <vector>
+
+#include "handler.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+// Settings by "section.key" name, each list sorted.
+struct ConfigDiff {
+	vector<string> added;
+	vector<string> removed;
+	vector<string> changed;
+
+	// True if both configs hold the same settings.
+	bool Empty() const;
+};
+
+// Compare two handlers. Sections whose hashes match are skipped without
+// looking at their settings, and settings within other sections are compared
+// by their item hashes, so the cost is proportional to the size of the change
+// rather than the size of the config. Hashes are computed at load time, so
+// items modified through Handler::Get() afterwards are not noticed.
+ConfigDiff Diff(const Handler&, const Handler&);
+
+} // namespace config
+
+#endif // CONFIG_DIFF_H_
@@ -0,0 +1,103 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "../common/lest.hpp"
+#include "diff.h"
+
+// Load a config from a string.
+config::Handler LoadString(const std::string& contents, const std::vector<std::string>& overrides) {
+	std::string filename = (std::filesystem::temp_directory_path() / "config_diff_test.ini").string();
+	{
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		file << contents;
+	}
+	config::Handler handler;
+	handler.Load(filename, overrides);
+	std::filesystem::remove(filename);
+	return handler;
+}
+
+using Names = std::vector<std::string>;
+
+const lest::test specification[] = {
+	CASE("Identical configs have no differences") {
+		config::Handler a;
+		config::Handler b;
+		EXPECT(a.Load("sample.ini", {"production", "ubuntu"}) == true);
+		EXPECT(b.Load("sample.ini", {"production", "ubuntu"}) == true);
+		EXPECT(config::Diff(a, b).Empty() == true);
+		EXPECT(config::Diff(a, a).Empty() == true);
+
+		// Formatting alone does not count as a change
+		config::Handler c = LoadString("[s]\nx = 1 ; one\ny=\"a b\"\n", {});
+		config::Handler d = LoadString("[s]\ny=\"a b\"\n\n  x=1\n", {});
+		EXPECT(config::Diff(c, d).Empty() == true);
+	},
+
+	CASE("Added, removed and changed settings are reported") {
+		config::Handler a = LoadString(
+			"[same]\nk=1\n"
+			"[edit]\nkept=1\nchanged=1\nremoved=1\nlist=a,b\n"
+			"[gone]\nk=1\nl=2\n", {});
+		config::Handler b = LoadString(
+			"[edit]\nkept=1\nchanged=\"1\"\nadded=1\nlist=ab\n"
+			"[new]\nk=1\n"
+			"[same]\nk=1\n", {});
+
+		config::ConfigDiff diff = config::Diff(a, b);
+		EXPECT(diff.added == (Names{"edit.added", "new.k"}));
+		EXPECT(diff.removed == (Names{"edit.removed", "gone.k", "gone.l"}));
+		EXPECT(diff.changed == (Names{"edit.changed", "edit.list"}));
+
+		config::ConfigDiff reverse = config::Diff(b, a);
+		EXPECT(reverse.added == diff.removed);
+		EXPECT(reverse.removed == diff.added);
+		EXPECT(reverse.changed == diff.changed);
+	},
+
+	CASE("Overrides change the values that are compared") {
+		config::Handler production;
+		config::Handler staging;
+		EXPECT(production.Load("sample.ini", {"production"}) == true);
+		EXPECT(staging.Load("sample.ini", {"staging"}) == true);
+
+		config::ConfigDiff diff = config::Diff(production, staging);
+		EXPECT(diff.added.empty());
+		EXPECT(diff.removed.empty());
+		EXPECT(diff.changed == (Names{"ftp.path", "http.path"}));
+	},
+
+	CASE("Incremental reloads keep section hashes up to date") {
+		std::string filename = (std::filesystem::temp_directory_path() / "config_diff_reload_test.ini").string();
+		{
+			std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+			file << "[a]\nk=1\n[b]\nk=1\n";
+		}
+		config::Handler handler;
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		config::Handler before = handler;
+		{
+			std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+			file << "[a]\nk=1\n[b]\nk=2\n[c]\nk=1\n";
+		}
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+
+		config::ConfigDiff diff = config::Diff(before, handler);
+		EXPECT(diff.added == (Names{"c.k"}));
+		EXPECT(diff.removed.empty());
+		EXPECT(diff.changed == (Names{"b.k"}));
+
+		// Matches a full load of the same file
+		config::Handler full;
+		EXPECT(full.Load(filename, {}) == true);
+		EXPECT(config::Diff(full, handler).Empty() == true);
+		std::filesystem::remove(filename);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -0,0 +1,466 @@
+/*
+ * An EmbeddedConfig object is an ini file that was parsed by the compiler.
+ * It follows the same rules as Parser, so config text baked into the binary
+ * costs nothing at startup and lives in read-only data:
+ *
+ *   constexpr char kDefaults[] = "[common]\npath = /tmp/\n";
+ *   constexpr auto defaults = config::ParseEmbedded<kDefaults>();
+ *   static_assert(defaults.GetString("common.path", "") == "/tmp/");
+ *
+ * Embedded configs have no overrides. Settings that carry an override are
+ * skipped, just as Handler skips overrides that were not requested. A
+ * malformed embedded config is a compile error.
+ */
+
+#ifndef CONFIG_EMBEDDED_H_
+#define CONFIG_EMBEDDED_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+
+#include "item.h"
+#include "parser.h"
+#include "units.h"
+#include "views.h"
+
+namespace config {
+namespace embedded {
+
+// Upper bounds for the storage of an embedded config, computed before parsing.
+struct Measure {
+	size_t text;
+	size_t entries;
+	size_t elements;
+};
+
+constexpr Measure MeasureText(std::string_view in) {
+	Measure m = {in.size(), 0, 0};
+	for (const auto& c : in) {
+		if (c == constants::EQUALS) {
+			m.entries++;
+		} else if (c == constants::COMMA) {
+			m.elements++;
+		}
+	}
+	// Every list has one more element than it has commas.
+	m.elements += m.entries;
+	return m;
+}
+
+constexpr bool IsAlnum(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr bool IsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+constexpr bool IsNameChar(char c) {
+	return IsAlnum(c) || c == constants::HYPHEN || c == constants::UNDERSCORE;
+}
+
+// The UTF-8 curly quotes that Parser::StripLine normalizes.
+constexpr std::string_view LEFT_QUOTE = "\u201C"; // “
+constexpr std::string_view RIGHT_QUOTE = "\u201D"; // ”
+
+// The "section.key" delimiter, matching Handler.
+constexpr char SECTION_DELIM = '.';
+
+} // namespace embedded
+
+template <size_t TextSize, size_t MaxEntries, size_t MaxElements>
+class EmbeddedConfig {
+  private:
+	struct Entry {
+		Span section = {0, 0};
+		Span key = {0, 0};
+		ValueType type = ValueType::STRING;
+		bool booleanValue = false;
+		// Also holds sizes and durations.
+		int64_t integerValue = 0;
+		double doubleValue = 0;
+		// A span into text for strings, or into elements for lists.
+		Span value = {0, 0};
+	};
+
+	// Every stripped section, key and value, back to back.
+	std::array<char, TextSize + 1> text{};
+	size_t textSize = 0;
+
+	// Entries sorted by section, then key.
+	std::array<Entry, MaxEntries + 1> entries{};
+	size_t count = 0;
+
+	// Spans of every list element, referenced by a list entry's value.
+	std::array<Span, MaxElements + 1> elements{};
+	size_t elementCount = 0;
+
+	constexpr std::string_view View(Span span) const {
+		return std::string_view(text.data() + span.offset, span.length);
+	}
+
+	constexpr Span Append(std::string_view in) {
+		Span span = {static_cast<uint32_t>(textSize), static_cast<uint32_t>(in.size())};
+		for (const auto& c : in) {
+			text[textSize++] = c;
+		}
+		return span;
+	}
+
+	// Same rules as Parser::ConstructValueObject.
+	constexpr void ConstructValue(std::string_view in, Entry& entry) {
+		if (in.size() == 0) {
+			entry.type = ValueType::STRING;
+			entry.value = Append(in);
+			return;
+		}
+		if (in[0] == constants::QUOTE) {
+			entry.type = ValueType::STRING;
+			entry.value = Append(in.substr(1, in.size() - (in.size() > 1 ? 2 : 1)));
+			return;
+		}
+
+		// Numbers
+		bool isNum = true;
+		bool foundSign = (in[0] == constants::HYPHEN);
+		bool foundDecimal = false;
+		size_t digits = 0;
+		for (size_t i = foundSign ? 1 : 0; i < in.size(); i++) {
+			if (in[i] == constants::DECIMAL) {
+				if (foundDecimal) {
+					isNum = false;
+					break;
+				}
+				foundDecimal = true;
+			} else if (embedded::IsDigit(in[i])) {
+				digits++;
+			} else {
+				isNum = false;
+				break;
+			}
+		}
+		if (isNum) {
+			if (digits == 0) {
+				// Parser rejects these through std::stoll/std::stod.
+				throw std::runtime_error(foundDecimal ? errors::SETTING_MAX_DOUBLE : errors::SETTING_MAX_INTEGER);
+			}
+			if (foundDecimal) {
+				// Note: digits are accumulated in double precision, so values
+				// with more than 15 significant digits may differ from
+				// std::stod in the last place.
+				double whole = 0;
+				double fraction = 0;
+				double scale = 1;
+				bool afterDecimal = false;
+				for (size_t i = foundSign ? 1 : 0; i < in.size(); i++) {
+					if (in[i] == constants::DECIMAL) {
+						afterDecimal = true;
+					} else if (afterDecimal) {
+						fraction = fraction * 10 + (in[i] - '0');
+						scale *= 10;
+					} else {
+						whole = whole * 10 + (in[i] - '0');
+					}
+				}
+				double value = whole + fraction / scale;
+				if (value > std::numeric_limits<double>::max()) {
+					throw std::runtime_error(errors::SETTING_MAX_DOUBLE);
+				}
+				entry.type = ValueType::DOUBLE;
+				entry.doubleValue = foundSign ? -value : value;
+				return;
+			}
+			// Accumulate negatively so that the smallest int64_t fits.
+			int64_t value = 0;
+			for (size_t i = foundSign ? 1 : 0; i < in.size(); i++) {
+				int digit = in[i] - '0';
+				if (value < (std::numeric_limits<int64_t>::min() + digit) / 10) {
+					throw std::runtime_error(errors::SETTING_MAX_INTEGER);
+				}
+				value = value * 10 - digit;
+			}
+			if (!foundSign) {
+				if (value == std::numeric_limits<int64_t>::min()) {
+					throw std::runtime_error(errors::SETTING_MAX_INTEGER);
+				}
+				value = -value;
+			}
+			entry.type = ValueType::INTEGER;
+			entry.integerValue = value;
+			return;
+		}
+
+		// Sizes and durations
+		if (embedded::IsDigit(in[0])) {
+			ValueType unitType = ValueType::INTEGER;
+			int64_t amount = 0;
+			UnitRead read = ReadUnitValue(in, unitType, amount);
+			if (read == UnitRead::TOO_LARGE) {
+				throw std::runtime_error(errors::SETTING_MAX_UNIT);
+			}
+			if (read == UnitRead::VALUE) {
+				entry.type = unitType;
+				entry.integerValue = amount;
+				return;
+			}
+		}
+
+		// Booleans
+		if (in == "yes" || in == "true" || in == "no" || in == "false") {
+			entry.type = ValueType::BOOLEAN;
+			entry.booleanValue = (in == "yes" || in == "true");
+			return;
+		}
+
+		// Lists of non-empty, comma-separated values
+		size_t first = elementCount;
+		size_t start = 0;
+		for (size_t i = 0; i <= in.size(); i++) {
+			if (i == in.size() || in[i] == constants::COMMA) {
+				if (i > start) {
+					elements[elementCount++] = Append(in.substr(start, i - start));
+				}
+				start = i + 1;
+			}
+		}
+		if (elementCount - first > 1) {
+			entry.type = ValueType::LIST;
+			entry.value = {static_cast<uint32_t>(first), static_cast<uint32_t>(elementCount - first)};
+			return;
+		}
+
+		// Strings; drop the single element that was appended above.
+		if (elementCount > first) {
+			textSize = elements[first].offset;
+			elementCount = first;
+		}
+		entry.type = ValueType::STRING;
+		entry.value = Append(in);
+	}
+
+	// Same rules as Parser::ParseSetting. Settings with an override are
+	// skipped; malformed settings throw.
+	constexpr void ParseSetting(std::string_view in, Span section) {
+		size_t pos = in.find(constants::EQUALS);
+		if (in.size() < 3 || pos == std::string_view::npos || pos == 0 || pos == in.size() - 1) {
+			throw std::runtime_error(errors::EMBEDDED_SETTING);
+		}
+		std::string_view left = in.substr(0, pos);
+		size_t oStart = left.find(constants::OVERRIDE_START);
+		size_t oEnd = left.find(constants::OVERRIDE_END);
+		bool foundStart = (oStart != std::string_view::npos);
+		bool foundEnd = (oEnd != std::string_view::npos);
+		if (foundStart != foundEnd || (foundStart && (oStart == 0 || oEnd != left.size() - 1))) {
+			throw std::runtime_error(errors::EMBEDDED_SETTING);
+		}
+		if (foundStart) {
+			for (size_t i = oStart + 1; i < oEnd; i++) {
+				if (!embedded::IsNameChar(left[i])) {
+					throw std::runtime_error(errors::EMBEDDED_SETTING);
+				}
+			}
+			if (oEnd > oStart + 1) {
+				return;
+			}
+		}
+		std::string_view key = foundStart ? in.substr(0, oStart) : left;
+
+		// A repeated key replaces the earlier value, as in Handler.
+		size_t slot = count;
+		for (size_t i = 0; i < count; i++) {
+			if (View(entries[i].section) == View(section) && View(entries[i].key) == key) {
+				slot = i;
+				break;
+			}
+		}
+		Entry entry;
+		entry.section = section;
+		entry.key = (slot == count) ? Append(key) : entries[slot].key;
+		ConstructValue(in.substr(pos + 1), entry);
+		entries[slot] = entry;
+		if (slot == count) {
+			count++;
+		}
+	}
+
+	// Sort entries by section, then key, so that lookups can bisect.
+	constexpr void Sort() {
+		for (size_t i = 1; i < count; i++) {
+			Entry entry = entries[i];
+			size_t j = i;
+			while (j > 0 && Less(entry, entries[j-1])) {
+				entries[j] = entries[j-1];
+				j--;
+			}
+			entries[j] = entry;
+		}
+	}
+
+	constexpr bool Less(const Entry& a, const Entry& b) const {
+		int c = View(a.section).compare(View(b.section));
+		return c < 0 || (c == 0 && View(a.key) < View(b.key));
+	}
+
+	// Returns the index of a "section.key", or count if not found.
+	constexpr size_t Find(std::string_view name) const {
+		size_t pos = name.find(embedded::SECTION_DELIM);
+		if (pos == std::string_view::npos) {
+			return count;
+		}
+		std::string_view section = name.substr(0, pos);
+		std::string_view key = name.substr(pos + 1);
+		size_t low = 0;
+		size_t high = count;
+		while (low < high) {
+			size_t mid = low + (high - low) / 2;
+			int c = View(entries[mid].section).compare(section);
+			if (c == 0) {
+				c = View(entries[mid].key).compare(key);
+			}
+			if (c == 0) {
+				return mid;
+			}
+			if (c < 0) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		return count;
+	}
+
+	constexpr const Entry* FindEntry(std::string_view name, ValueType type) const {
+		size_t i = Find(name);
+		if (i == count || entries[i].type != type) {
+			return nullptr;
+		}
+		return &entries[i];
+	}
+
+  public:
+	constexpr explicit EmbeddedConfig(std::string_view source) {
+		// Scratch space for one stripped line.
+		std::array<char, TextSize + 1> line{};
+		Span section = {0, 0};
+
+		size_t start = 0;
+		while (start <= source.size()) {
+			size_t end = source.find('\n', start);
+			if (end == std::string_view::npos) {
+				end = source.size();
+			}
+
+			// Same rules as Parser::StripLine, which replaces only the first
+			// curly quote of each kind.
+			std::string_view text = source.substr(start, end - start);
+			size_t leftPos = text.find(embedded::LEFT_QUOTE);
+			size_t rightPos = text.find(embedded::RIGHT_QUOTE);
+			size_t length = 0;
+			bool inQuotes = false;
+			for (size_t i = 0; i < text.size(); i++) {
+				char c = text[i];
+				if (i == leftPos || i == rightPos) {
+					c = constants::QUOTE;
+					i += embedded::LEFT_QUOTE.size() - 1;
+				}
+				if (c == constants::COMMENT_DELIM && !inQuotes) {
+					break;
+				}
+				if (c == constants::QUOTE) {
+					inQuotes = !inQuotes;
+				} else if (!inQuotes && c == constants::SPACE) {
+					continue;
+				}
+				line[length++] = c;
+			}
+			std::string_view stripped(line.data(), length);
+
+			if (length > 0) {
+				// Same rules as Parser::IsValidSection.
+				bool isSection = length >= 3 && stripped[0] == constants::SECTION_START &&
+					stripped[length-1] == constants::SECTION_END;
+				for (size_t i = 1; isSection && i < length - 1; i++) {
+					isSection = embedded::IsNameChar(stripped[i]);
+				}
+				if (isSection) {
+					section = Append(stripped.substr(1, length - 2));
+				} else {
+					ParseSetting(stripped, section);
+				}
+			}
+			start = end + 1;
+		}
+		Sort();
+	}
+
+	// Number of settings.
+	constexpr size_t Size() const {
+		return count;
+	}
+
+	constexpr bool Contains(std::string_view name) const {
+		return Find(name) != count;
+	}
+
+	// Typed getters with the same fallback contract as Handler's noexcept
+	// getters: missing settings and type mismatches return the fallback.
+	constexpr std::string_view GetString(std::string_view name, std::string_view fallback) const {
+		const Entry* entry = FindEntry(name, ValueType::STRING);
+		return entry == nullptr ? fallback : View(entry->value);
+	}
+
+	constexpr bool GetBoolean(std::string_view name, bool fallback) const {
+		const Entry* entry = FindEntry(name, ValueType::BOOLEAN);
+		return entry == nullptr ? fallback : entry->booleanValue;
+	}
+
+	// Also reads sizes, as Handler does.
+	constexpr int64_t GetInteger(std::string_view name, int64_t fallback) const {
+		const Entry* entry = FindEntry(name, ValueType::INTEGER);
+		if (entry == nullptr) {
+			entry = FindEntry(name, ValueType::SIZE);
+		}
+		return entry == nullptr ? fallback : entry->integerValue;
+	}
+
+	constexpr double GetDouble(std::string_view name, double fallback) const {
+		const Entry* entry = FindEntry(name, ValueType::DOUBLE);
+		return entry == nullptr ? fallback : entry->doubleValue;
+	}
+
+	// Bytes of a size setting.
+	constexpr int64_t GetSize(std::string_view name, int64_t fallback) const {
+		const Entry* entry = FindEntry(name, ValueType::SIZE);
+		return entry == nullptr ? fallback : entry->integerValue;
+	}
+
+	constexpr std::chrono::nanoseconds GetDuration(std::string_view name, std::chrono::nanoseconds fallback) const {
+		const Entry* entry = FindEntry(name, ValueType::DURATION);
+		return entry == nullptr ? fallback : std::chrono::nanoseconds(entry->integerValue);
+	}
+
+	// Returns an empty list if missing or not a list.
+	constexpr ListView GetList(std::string_view name) const {
+		const Entry* entry = FindEntry(name, ValueType::LIST);
+		if (entry == nullptr) {
+			return ListView();
+		}
+		return ListView(text.data(), elements.data() + entry->value.offset, entry->value.length);
+	}
+};
+
+// Parse a constexpr character array into an EmbeddedConfig sized for it.
+template <const char* Source>
+constexpr auto ParseEmbedded() {
+	constexpr embedded::Measure m = embedded::MeasureText(Source);
+	return EmbeddedConfig<m.text, m.entries, m.elements>(Source);
+}
+
+} // namespace config
+
+#endif // CONFIG_EMBEDDED_H_
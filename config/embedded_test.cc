@@ -0,0 +1,132 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "../common/lest.hpp"
+#include "embedded.h"
+#include "handler.h"
+
+// The contents of sample.ini, parsed by the compiler.
+constexpr char kSample[] =
+	"[common]\n"
+	"basic_size_limit = 26214400\n"
+	"student_size_limit = 52428800\n"
+	"paid_users_size_limit = 2147483648\n"
+	"path = /srv/var/tmp/\n"
+	"path<itscript> = /srv/tmp/\n"
+	"\n"
+	"[ftp]\n"
+	"name = \xE2\x80\x9Chello there, ftp uploading\xE2\x80\x9D\n"
+	"path = /tmp/\n"
+	"path<production> = /srv/var/tmp/\n"
+	"enabled = no\n"
+	"\n"
+	"; This is a comment\n"
+	"[http]\n"
+	"name = \"http uploading\"\n"
+	"path = /tmp/; This is another comment\n"
+	"params = array,of,values\n"
+	"ratio = -0.25\n"
+	"min = -9223372036854775808\n";
+
+constexpr auto kDefaults = config::ParseEmbedded<kSample>();
+
+// Everything below is evaluated at compile time.
+static_assert(kDefaults.Size() == 12, "overrides are skipped");
+static_assert(kDefaults.GetInteger("common.paid_users_size_limit", 0) == 2147483648, "");
+static_assert(kDefaults.GetString("common.path", "") == "/srv/var/tmp/", "");
+static_assert(kDefaults.GetString("ftp.name", "") == "hello there, ftp uploading", "");
+static_assert(kDefaults.GetBoolean("ftp.enabled", true) == false, "");
+static_assert(kDefaults.GetDouble("http.ratio", 0) == -0.25, "");
+static_assert(kDefaults.GetInteger("http.min", 0) == std::numeric_limits<int64_t>::min(), "");
+static_assert(kDefaults.GetList("http.params").size() == 3, "");
+static_assert(kDefaults.GetList("http.params")[1] == "of", "");
+
+// Sizes and durations follow the same rules as Parser.
+constexpr char kLimits[] =
+	"[upload]\n"
+	"limit = 25MiB\n"
+	"timeout = 500ms\n"
+	"retries = 3\n"
+	"name = 3rd\n";
+
+constexpr auto kLimitDefaults = config::ParseEmbedded<kLimits>();
+
+static_assert(kLimitDefaults.GetSize("upload.limit", 0) == 26214400, "");
+static_assert(kLimitDefaults.GetDuration("upload.timeout", {}) == std::chrono::milliseconds(500), "");
+static_assert(kLimitDefaults.GetSize("upload.retries", -1) == -1, "");
+static_assert(kLimitDefaults.GetInteger("upload.limit", -1) == 26214400, "");
+static_assert(kLimitDefaults.GetInteger("upload.timeout", -1) == -1, "");
+static_assert(kLimitDefaults.GetString("upload.name", "") == "3rd", "");
+
+// Only the first curly quote of each kind is normalized, as in Parser.
+constexpr char kQuotes[] =
+	"[quotes]\n"
+	"name = x \xE2\x80\x9C" "a b\xE2\x80\x9D y \xE2\x80\x9C" "c d\xE2\x80\x9D\n";
+
+constexpr auto kQuoteDefaults = config::ParseEmbedded<kQuotes>();
+
+const lest::test specification[] = {
+	CASE("An embedded config matches the same config loaded by Handler") {
+		config::Handler handler;
+		EXPECT(handler.Load("sample.ini", {}) == true);
+
+		handler.ForEach([&](const std::string& key, const config::Item& item) {
+			EXPECT(kDefaults.Contains(key));
+			switch (item.GetValueType()) {
+				case config::ValueType::STRING:
+				EXPECT(kDefaults.GetString(key, "") == item.GetStringView());
+				break;
+				case config::ValueType::BOOLEAN:
+				EXPECT(kDefaults.GetBoolean(key, true) == item.GetBoolean());
+				break;
+				case config::ValueType::INTEGER:
+				EXPECT(kDefaults.GetInteger(key, 0) == item.GetInteger());
+				break;
+				case config::ValueType::DOUBLE:
+				EXPECT(kDefaults.GetDouble(key, 0) == item.GetDouble());
+				break;
+				case config::ValueType::LIST:
+				EXPECT(kDefaults.GetList(key).size() == item.GetListView().size());
+				break;
+				case config::ValueType::SIZE:
+				EXPECT(kDefaults.GetSize(key, -1) == item.GetSize());
+				break;
+				case config::ValueType::DURATION:
+				EXPECT(kDefaults.GetDuration(key, {}) == item.GetDuration());
+				break;
+			}
+		});
+	},
+
+	CASE("Repeated curly quotes are stripped as Handler strips them") {
+		std::string filename = (std::filesystem::temp_directory_path() /
+			(std::to_string(getpid()) + "_quotes.ini")).string();
+		{
+			std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+			file << kQuotes;
+		}
+		config::Handler handler;
+		EXPECT(handler.Load(filename, {}) == true);
+		std::filesystem::remove(filename);
+
+		EXPECT(kQuoteDefaults.GetString("quotes.name", "") == handler.GetString("quotes.name", ""));
+		EXPECT(kQuoteDefaults.GetString("quotes.name", "") == "x\"a b\"y\xE2\x80\x9C" "cd\xE2\x80\x9D");
+	},
+
+	CASE("Missing settings and type mismatches return the fallback") {
+		EXPECT(kDefaults.GetInteger("ftp.foobar123", -1) == -1);
+		EXPECT(kDefaults.GetInteger("ftp.path", -1) == -1);
+		EXPECT(kDefaults.GetString("nodelimiter", "none") == "none");
+		EXPECT(kDefaults.GetList("ftp.path").empty());
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -9,10 +9,30 @@ namespace config {
 namespace errors {
 
 // Error strings go here, placed alphabetically.
+static const char* CODEGEN_IDENTIFIER = "Two settings in the schema map to the same C++ identifier";
+static const char* CODEGEN_KEY_HASH = "Two settings in the schema have the same typed key hash";
+static const char* CODEGEN_PERFECT_HASH = "Unable to find a perfect hash for the schema keys";
+static const char* DAEMON_INVALID = "The served config file contained an invalid setting";
+static const char* DAEMON_REQUEST = "A config daemon request exceeded the protocol's limits";
+static const char* DAEMON_RESPONSE = "The config daemon sent a failed or malformed response";
+static const char* DAEMON_SOCKET = "Unable to open or connect to the config daemon socket";
+static const char* DERIVED_TYPE = "A derived value was requested as another type than it was derived as";
+static const char* EMBEDDED_SETTING = "The embedded config contained a malformed setting";
 static const char* FILE_OPEN = "Unable to open config file";
+static const char* FILE_WRITE = "Unable to write config file";
+static const char* INTERNER_MAX_SIZE = "The config contained more distinct names than can be interned (32-bit IDs)";
+static const char* SAVE_CONFLICT = "The config file changed on disk since it was loaded";
+static const char* SCHEMA_RULE = "The schema contained a malformed or unknown rule";
+static const char* SETTING_KEY = "Settings need a \"section.key\" name";
 static const char* SETTING_MAX_INTEGER = "The config file contained an integer larger than the supported max (64-bit signed)";
 static const char* SETTING_MAX_DOUBLE = "The config file contained a floating point value larger than the supported max";
+static const char* SETTING_MAX_UNIT = "The config file contained a size or duration larger than the supported max (64-bit signed bytes or nanoseconds)";
+static const char* SETTING_UNWRITABLE = "This config item cannot be written as a config value";
+static const char* SHARED_MEMORY = "Unable to create or map a shared memory config segment";
+static const char* STORE_MAX_SIZE = "The config store exceeded its maximum addressable size (32-bit offsets)";
+static const char* SUBSCRIPTION_KEY = "Key subscriptions need a \"section.key\" name";
 static const char* TYPE_MISMATCH = "This config item is not of this value type";
+static const char* WATCHER_INVALID = "The watched config file contained an invalid setting";
 
 } // namespace errors
 } // namespace Config
@@ -0,0 +1,124 @@
+#include <array>
+#include <cstring>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CONFIG_CRC32C_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CONFIG_CRC32C_ARM
+#endif
+
+#include "fingerprint.h"
+
+namespace config {
+
+// For readability
+using std::string;
+
+namespace {
+
+// Reflected CRC32C polynomial.
+const uint32_t CRC32C_POLY = 0x82F63B78;
+
+constexpr std::array<uint32_t, 256> MakeCrc32cTable() {
+	std::array<uint32_t, 256> table{};
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC32C_TABLE = MakeCrc32cTable();
+
+uint32_t Crc32cSoftware(const char* data, size_t length, uint32_t crc) {
+	for (size_t i = 0; i < length; i++) {
+		crc = CRC32C_TABLE[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#if defined(CONFIG_CRC32C_X86)
+// Compiled for SSE4.2 regardless of the build flags; only called after a
+// runtime CPU check.
+__attribute__((target("sse4.2")))
+uint32_t Crc32cHardware(const char* data, size_t length, uint32_t crc) {
+	uint64_t crc64 = crc;
+	for (; length >= 8; data += 8, length -= 8) {
+		uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = static_cast<uint32_t>(crc64);
+	for (; length > 0; data++, length--) {
+		crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+	}
+	return crc;
+}
+
+bool HasHardwareCrc32c() {
+	static const bool supported = __builtin_cpu_supports("sse4.2");
+	return supported;
+}
+#elif defined(CONFIG_CRC32C_ARM)
+uint32_t Crc32cHardware(const char* data, size_t length, uint32_t crc) {
+	for (; length >= 8; data += 8, length -= 8) {
+		uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+		crc = __crc32cd(crc, word);
+	}
+	for (; length > 0; data++, length--) {
+		crc = __crc32cb(crc, static_cast<uint8_t>(*data));
+	}
+	return crc;
+}
+
+bool HasHardwareCrc32c() {
+	// The build targets a CPU with the CRC32 extension.
+	return true;
+}
+#endif
+
+} // namespace
+
+bool Fingerprint::SameStat(const Fingerprint& other) const {
+	return device == other.device && inode == other.inode &&
+		size == other.size && mtimeNanos == other.mtimeNanos;
+}
+
+bool Fingerprint::SameContents(const Fingerprint& other) const {
+	return size == other.size && checksum == other.checksum;
+}
+
+bool StatFile(const string& filename, Fingerprint& fingerprint) {
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0) {
+		return false;
+	}
+	fingerprint.device = static_cast<uint64_t>(info.st_dev);
+	fingerprint.inode = static_cast<uint64_t>(info.st_ino);
+	fingerprint.size = static_cast<uint64_t>(info.st_size);
+#if defined(__APPLE__)
+	fingerprint.mtimeNanos = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	fingerprint.mtimeNanos = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+uint32_t Crc32c(std::string_view in, uint32_t previous) {
+	uint32_t crc = ~previous;
+#if defined(CONFIG_CRC32C_X86) || defined(CONFIG_CRC32C_ARM)
+	if (HasHardwareCrc32c()) {
+		return ~Crc32cHardware(in.data(), in.size(), crc);
+	}
+#endif
+	return ~Crc32cSoftware(in.data(), in.size(), crc);
+}
+
+} // namespace config
@@ -0,0 +1,49 @@
+/*
+ * A Fingerprint identifies a version of a config file, first by its stat
+ * metadata and then by a checksum of its contents, so that reloads can skip
+ * files that have not changed.
+ */
+
+#ifndef CONFIG_FINGERPRINT_H_
+#define CONFIG_FINGERPRINT_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace config {
+
+// For readability
+using std::string;
+
+struct Fingerprint {
+	// Stat metadata; a change in any of these means the file may differ.
+	uint64_t device = 0;
+	uint64_t inode = 0;
+	uint64_t size = 0;
+	int64_t mtimeNanos = 0;
+
+	// CRC32C of the file contents. Equal sizes and checksums mean the
+	// contents are, for all practical purposes, identical. This is the value
+	// to compare when checking config versions across hosts.
+	uint32_t checksum = 0;
+
+	// True if the stat metadata of both fingerprints match.
+	bool SameStat(const Fingerprint&) const;
+
+	// True if the size and checksum of both fingerprints match.
+	bool SameContents(const Fingerprint&) const;
+};
+
+// Fill in the stat metadata of a file. Returns false if it cannot be stat'ed.
+bool StatFile(const string&, Fingerprint&);
+
+// CRC32C (Castagnoli) of a buffer. Uses the SSE4.2 or ARMv8 CRC32
+// instructions when the CPU supports them, and a lookup table otherwise.
+// Passing the checksum of preceding data extends it, so that
+// Crc32c(b, Crc32c(a)) == Crc32c(a + b).
+uint32_t Crc32c(std::string_view, uint32_t previous = 0);
+
+} // namespace config
+
+#endif // CONFIG_FINGERPRINT_H_
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "../common/lest.hpp"
+#include "fingerprint.h"
+
+const lest::test specification[] = {
+	CASE("Crc32c matches the standard check values") {
+		EXPECT(config::Crc32c("") == 0x00000000u);
+		EXPECT(config::Crc32c("a") == 0xC1D04330u);
+		EXPECT(config::Crc32c("123456789") == 0xE3069283u);
+
+		// Lengths that are not a multiple of the hardware word size
+		std::string text = "The quick brown fox jumps over the lazy dog";
+		EXPECT(config::Crc32c(text) == 0x22620404u);
+		EXPECT(config::Crc32c(text.substr(0, 9)) != config::Crc32c(text.substr(0, 10)));
+
+		// Checksums can be extended piece by piece
+		uint32_t crc = config::Crc32c(text.substr(0, 13));
+		crc = config::Crc32c(text.substr(13, 5), crc);
+		crc = config::Crc32c(text.substr(18), crc);
+		EXPECT(crc == 0x22620404u);
+	},
+
+	CASE("StatFile fills in the stat metadata of a file") {
+		config::Fingerprint first;
+		config::Fingerprint second;
+		EXPECT(config::StatFile("sample.ini", first) == true);
+		EXPECT(config::StatFile("sample.ini", second) == true);
+		EXPECT(first.size > 0u);
+		EXPECT(first.inode != 0u);
+		EXPECT(first.SameStat(second) == true);
+
+		EXPECT(config::StatFile("foobar123.ini", first) == false);
+	},
+
+	CASE("Fingerprints compare stat metadata and contents separately") {
+		config::Fingerprint a;
+		a.inode = 1;
+		a.size = 10;
+		a.checksum = 42;
+		config::Fingerprint b = a;
+		b.inode = 2;
+		EXPECT(a.SameStat(b) == false);
+		EXPECT(a.SameContents(b) == true);
+		b.checksum = 43;
+		EXPECT(a.SameContents(b) == false);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -5,10 +5,25 @@
 #ifndef CONFIG_HANDLER_H_
 #define CONFIG_HANDLER_H_
 
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string_view>
+#include <typeinfo>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "fingerprint.h"
+#include "interner.h"
+#include "key.h"
+#include "load_context.h"
 #include "parser.h"
+#include "schema.h"
 
 namespace config {
 
@@ -19,15 +34,263 @@ using std::vector;
 
 extern const char SECTION_DELIM;
 
+struct ConfigDiff;
+
+// The outcome of Handler::Reload.
+enum ReloadStatus {
+	// The file and overrides match the last load; nothing was parsed.
+	UNCHANGED,
+	// The file was parsed and replaced every previously loaded setting.
+	RELOADED,
+	// The file has an invalid setting; the previous settings were kept.
+	INVALID
+};
+
 class Handler {
   private:
-	// A map to hold each individual setting in memory for O(1) access.
-	unordered_map<string, config::Item> settingsSingle;
+	// Compares the section hashes of two handlers.
+	friend ConfigDiff Diff(const Handler&, const Handler&);
+
+	// Backs the settings maps, and is the upstream of each load's scratch arena.
+	std::pmr::memory_resource* resource;
+
+	// Every section name, key name and override tag, interned to a dense ID.
+	Interner names;
+
+	// A map to hold each individual setting in memory for O(1) access,
+	// keyed by the packed (section ID, key ID) pair.
+	std::pmr::unordered_map<uint64_t, config::Item> settingsSingle;
 
 	// A map to hold a symbolized hashmap of every section in memory for O(1) access.
 	unordered_map<string, unordered_map<string, config::Item>> settingsSection;
 
+	// Maps the precomputed hash of a "section.key" to its packed IDs and item
+	// in settingsSingle, for typed Key lookups. Hashes shared by more than one
+	// key map to a NULL item, and those lookups fall back to settingsSingle.
+	// The IDs let a lookup tell its key from a missing one with the same hash.
+	struct KeyEntry {
+		uint64_t ids;
+		const config::Item* item;
+	};
+	std::pmr::unordered_map<uint64_t, KeyEntry> keyIndex;
+
+	// The fingerprint of the most recently loaded file, and the overrides it
+	// was loaded with. Only meaningful once loaded is true.
+	Fingerprint fingerprint;
+	vector<string> loadedOverrides;
+	bool loaded;
+
+	// The combined checksum and length of every block of a section.
+	struct SectionChecksum {
+		uint32_t crc = 0;
+		uint64_t length = 0;
+
+		bool operator==(const SectionChecksum& other) const {
+			return crc == other.crc && length == other.length;
+		}
+	};
+
+	// The checksum of each section of the most recently loaded file, by
+	// section ID. Only used for incremental reloads when exact is true,
+	// i.e. when the settings came from that one file and were not merged
+	// with those of an earlier load.
+	std::pmr::unordered_map<uint32_t, SectionChecksum> sectionChecksums;
+	bool exact;
+
+	// An order-independent hash of every setting in a section, by section ID:
+	// the sum of the mixed hashes of each key name and item hash. Sections
+	// without settings have no entry.
+	std::pmr::unordered_map<uint32_t, uint64_t> sectionHashes;
+
+	// The blocks of each section of the most recently loaded file, by
+	// section ID, in file order.
+	using SectionBlocks = std::pmr::unordered_map<uint32_t, std::pmr::vector<SectionBlock>>;
+	SectionBlocks sectionBlocks;
+
+	// Where the value text of a setting is in the loaded file: the ordinal of
+	// a block among the blocks of its section, and a byte range relative to
+	// the start of that block. Relative offsets stay valid when other
+	// sections are reparsed or saved and their blocks move.
+	struct SourceSpan {
+		uint32_t block;
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	// The source of every setting whose value was read from the loaded file,
+	// by packed (section ID, key ID) pair, and the settings set since, whose
+	// values differ from the file.
+	std::pmr::unordered_map<uint64_t, SourceSpan> sources;
+	std::pmr::unordered_set<uint64_t> dirty;
+
+	// The most recently loaded file.
+	string filename;
+
+	// A setting whose value refers to other settings, as in
+	// "path = ${common.path}/uploads": its value as written, and the packed
+	// (section ID, key ID) pairs of the settings it refers to, in order.
+	struct Template {
+		string text;
+		vector<uint64_t> references;
+	};
+
+	// The template of every interpolated setting, by packed ID pair. Their
+	// items in settingsSingle hold the expanded values.
+	using Templates = std::pmr::unordered_map<uint64_t, Template>;
+	Templates templates;
+
+	// The interpolated settings that refer to each setting, by packed ID
+	// pair: the reverse of the templates' references, so that a change only
+	// reexpands what is downstream of it.
+	std::pmr::unordered_map<uint64_t, vector<uint64_t>> dependents;
+
+	// Values expanded from templates, to be assigned once all of them
+	// expanded successfully.
+	using Expansions = vector<std::pair<uint64_t, config::Item>>;
+
+	// Identifies the current settings. Every change takes a new, globally
+	// unique version, and copies keep the version of what they copied, so
+	// two handlers with the same version hold the same settings.
+	uint64_t version;
+
+	// A value computed from settings by Derive(): the type it was computed
+	// as, the item hash of each of its dependencies at the time (0 for
+	// missing ones), and the version it was last known to be valid for.
+	struct DerivedValue {
+		const std::type_info* type;
+		std::shared_ptr<const void> value;
+		vector<uint64_t> hashes;
+		uint64_t version;
+	};
+
+	// Derived values by name. Filled in lazily by const readers, so guarded
+	// by a mutex. Copies share the values themselves.
+	mutable std::mutex derivedMutex;
+	mutable unordered_map<string, DerivedValue> derived;
+
+	// Take a new version, after the settings changed.
+	void Touch();
+
+	// The rules every load is checked against, if any, and the rules broken
+	// by the last load.
+	std::shared_ptr<const Schema> schema;
+	vector<SchemaViolation> violations;
+
+	// Check settings against the schema, looking them up by packed ID pair
+	// through the given function, and record the violations. Only checks
+	// the rules of the named sections, if given. Returns false if a rule is
+	// broken.
+	bool Validate(const std::function<const config::Item*(uint64_t)>&, const vector<string>*);
+
+	// The item hash of each of the given "section.key" settings, 0 if missing.
+	vector<uint64_t> DependencyHashes(const vector<string>&) const;
+
+	// The untyped implementation of Derive().
+	const void* Derive(const string&, const vector<string>&, const std::type_info&,
+		const std::function<std::shared_ptr<const void>()>&) const;
+
+	// The part of Reload after the file was read into the context's buffer,
+	// given the fingerprint of what was read.
+	ReloadStatus Apply(const string&, const vector<string>&, LoadContext&, const Fingerprint&);
+
+	// Parse the contents of a file, already read into the context's buffer,
+	// and merge its settings into the maps in place. Leaves the settings
+	// untouched and returns false if the file is invalid.
+	bool Parse(const vector<string>&, LoadContext&);
+
+	// Reparse only the sections of the context's buffer whose checksums
+	// changed since the last load, and swap them in. Leaves the settings
+	// untouched and returns false if a reparsed section is invalid.
+	bool Patch(const vector<string>&, LoadContext&);
+
+	// Intern the override tags into the context's set.
+	void InternOverrides(const vector<string>&, LoadContext&);
+
+	// Split the context's buffer into section blocks, group them by section,
+	// and checksum each section.
+	void SplitSections(LoadContext&, std::pmr::unordered_map<uint32_t, SectionChecksum>&, SectionBlocks&);
+
+	// Parse lines of the context's buffer, starting in the unnamed section,
+	// into the given maps, and record the source of each setting kept, and
+	// the template of each one that refers to other settings. Templates are
+	// not linked or expanded. Returns false on a malformed setting.
+	bool ParseRange(std::string_view, LoadContext&, std::pmr::unordered_map<uint64_t, config::Item>&,
+		std::pmr::unordered_map<uint64_t, SourceSpan>&, Templates&, const SectionBlocks&);
+
+	// Resolve the references of templates that were not linked yet to packed
+	// ID pairs. Returns false if a reference is malformed or names a section
+	// or key that does not exist.
+	bool LinkTemplates(Templates&) const;
+
+	// Expand the templates of the given settings, each at most once, in
+	// dependency order, skipping settings without one. A template's references are looked up through the
+	// given functions, which return NULL for missing settings and
+	// non-template settings, so that a patch can be expanded before it is
+	// swapped in; settings that are not being expanded keep their current,
+	// already expanded value. Returns false if a reference is missing or
+	// part of a cycle. Throws if an expanded value is invalid, like parsing.
+	bool Interpolate(const vector<uint64_t>&, const std::function<const config::Item*(uint64_t)>&,
+		const std::function<const Template*(uint64_t)>&, Expansions&) const;
+
+	// The given settings and every interpolated setting downstream of them.
+	vector<uint64_t> Downstream(vector<uint64_t>) const;
+
+	// Rebuild dependents from templates.
+	void BuildDependents();
+
+	// Replace or add the item of a packed ID pair, keeping the section map,
+	// section hash and keyIndex in sync.
+	void Assign(uint64_t, const config::Item&);
+
+	// Remove every setting of a section.
+	void RemoveSection(uint32_t);
+
+	// Rebuild keyIndex from settingsSingle.
+	void BuildKeyIndex();
+
+	// Rebuild sectionHashes from settingsSingle.
+	void BuildSectionHashes();
+
+	// The contribution of one setting to its section's hash.
+	uint64_t EntryHash(uint64_t, const config::Item&) const;
+
+	// Add or remove a single setting from keyIndex.
+	void IndexKey(uint64_t, const config::Item*);
+	void UnindexKey(uint64_t, const config::Item*);
+
+	// The source of a setting, given its raw line in a file's contents and
+	// the blocks of its section in that file.
+	static SourceSpan FindSource(std::string_view, std::string_view, const std::pmr::vector<SectionBlock>&);
+
+	// The typed Key hash of a packed (section ID, key ID) pair.
+	uint64_t KeyHash(uint64_t) const;
+
+	// Whether a packed (section ID, key ID) pair is the "section.key" name.
+	bool HasName(uint64_t, std::string_view) const noexcept;
+
+	// Pack a section ID and a key ID into a settingsSingle key.
+	static uint64_t PackIds(uint32_t, uint32_t);
+
+	// Look up a "section.key" name as a packed ID pair. Returns false if
+	// either name was never interned.
+	bool FindIds(std::string_view, uint64_t&) const;
+
   public:
+	// Allocate from the default memory resource.
+	Handler();
+
+	// Allocate the settings maps, and every load's scratch arena, from the
+	// given resource. Passing a std::pmr::monotonic_buffer_resource lets a
+	// whole config be released in one operation when the handler and the
+	// resource are dropped. The resource must outlive the handler.
+	explicit Handler(std::pmr::memory_resource*);
+
+	// keyIndex points into settingsSingle, so copies and moves rebuild it.
+	Handler(const Handler&);
+	Handler(Handler&&);
+	Handler& operator=(const Handler&);
+	Handler& operator=(Handler&&);
+
 	// The main loader function that takes a filename and a list of overrides.
 	// This function will return true if the load succeeded, throw an exception
 	// if it encounters a critical error (the caller should try-catch), and
@@ -36,15 +299,183 @@ class Handler {
 	// files with invalid settings. This is a design decision, and could be changed
 	// to be more tolerant and skip those settings instead; but doing so would
 	// expose the caller to risks of expecting settings that may not exist.
+	// A load that returns false or throws leaves the settings as they were.
+	//
+	// A value may refer to other settings as "${section.key}", anywhere in
+	// the file, e.g. "path = ${common.path}/uploads". A value that is one
+	// reference and nothing else takes the referenced item as it is; other
+	// values are parsed after each reference is replaced by the text of its
+	// value. Every such value is expanded once, when loaded, and again only
+	// when a setting upstream of it changes, through a reload or Set().
+	// References to settings that do not exist, and cycles of references,
+	// make the file invalid.
 	bool Load(string, vector<string>);
 
+	// Same as above, but keeps all scratch state (buffers, temporary hash
+	// tables and their capacity) in a caller-owned context. Reusing one
+	// context for repeated reloads of a similar-sized config avoids almost
+	// all scratch allocation after the first load.
+	bool Load(const string&, const vector<string>&, LoadContext&);
+
+	// Reload a file only if it changed since the last load. The stat metadata
+	// (device, inode, size, mtime) is checked first; if it differs, the file is
+	// read and its checksum compared, so a touched but unmodified file is not
+	// parsed either. If the file changed, only the sections whose checksums
+	// changed are reparsed, and their settings replaced; settings of other
+	// sections are kept as they are, at the same addresses. If the overrides
+	// changed too, or the settings were merged from several loads, the whole
+	// file is parsed into a fresh set of settings instead. Either way, nothing
+	// is replaced unless the whole file is valid. Unlike Load, settings removed
+	// from the file do not survive a reload. Throws on critical errors, like Load.
+	ReloadStatus Reload(const string&, const vector<string>&, LoadContext&);
+
+	// Same as above, with a one-off context.
+	ReloadStatus Reload(const string&, const vector<string>&);
+
+	// Reload the file that another handler just reloaded, from the contents
+	// its Reload read into the context, without reading the file again. If
+	// this handler held the same settings as the other one did before its
+	// Reload, it ends up with the same settings as the other one has now, so
+	// that a second copy of the settings can be kept up to date for the cost
+	// of the reload rather than of a copy. Nothing else may have used the
+	// context since.
+	ReloadStatus Replay(const Handler&, LoadContext&);
+
+	// The fingerprint of the most recently loaded file. Zeroed before the
+	// first successful load.
+	const Fingerprint& GetFingerprint() const;
+
+	// Add or replace a single "section.key" setting at runtime. Throws if the
+	// name has no section delimiter. Settings set this way last until the
+	// next reload that parses the file.
+	void Set(std::string_view, const config::Item&);
+
+	// Write the settings back to the file they were loaded from. Only the
+	// values of settings that were Set() since the load are rewritten, in
+	// place, so comments and formatting are kept. New settings are appended
+	// to their section, and new sections to the file. The file is replaced
+	// by renaming a temporary file over it, so readers never see a partial
+	// write. Throws if nothing was loaded, the file changed on disk since it
+	// was loaded, a value cannot be written as config text, or writing fails.
+	void Save();
+
+	// Same as above, but writes to another file, and leaves the loaded file
+	// as it is. A handler that never loaded a file writes every setting.
+	void Save(const string&);
+
 	// Get an individual setting. Returns NULL if not found.
 	config::Item* Get(string);
 
+	// Get an individual setting without copying the key. Returns NULL if not found.
+	const config::Item* Find(std::string_view) const noexcept;
+
+	// Get an individual setting by interned section and key IDs, as returned
+	// by GetNames(). Returns NULL if not found.
+	const config::Item* Find(uint32_t, uint32_t) const noexcept;
+
+	// The interner holding every section name, key name and override tag.
+	const Interner& GetNames() const;
+
+	// Exception-free typed getters for hot paths. Each returns the fallback
+	// if the setting is missing or holds a different type. Like integer
+	// keys, GetInteger also reads sizes.
+	std::string_view GetString(std::string_view, std::string_view) const noexcept;
+	bool GetBoolean(std::string_view, bool) const noexcept;
+	int64_t GetInteger(std::string_view, int64_t) const noexcept;
+	double GetDouble(std::string_view, double) const noexcept;
+	int64_t GetSize(std::string_view, int64_t) const noexcept;
+	std::chrono::nanoseconds GetDuration(std::string_view, std::chrono::nanoseconds) const noexcept;
+
+	// Exception-free getters for lists whose elements are all of one type.
+	// Each returns an empty view if the setting is missing or is not a list
+	// of that type. See Item::GetListType.
+	ArrayView<int64_t> GetIntList(std::string_view) const noexcept;
+	ArrayView<double> GetDoubleList(std::string_view) const noexcept;
+	ArrayView<bool> GetBoolList(std::string_view) const noexcept;
+
+	// Whether a list setting has an element equal to the value, or one that
+	// reads as the integer, or covers the path as itself or a directory
+	// above it. False if the setting is missing or not a list. Long lists
+	// are indexed when loaded; see Item::Contains.
+	bool Contains(std::string_view, std::string_view) const noexcept;
+	bool Contains(std::string_view, int64_t) const noexcept;
+	bool ContainsPath(std::string_view, std::string_view) const noexcept;
+
+	// Get an individual setting through a typed key whose hash was computed at
+	// compile time. Returns the fallback if the setting is missing. The type
+	// is only checked by a debug assertion, so the key type must match the
+	// config; in release builds a mismatch yields a zero/empty value.
+	template <typename T>
+	T Get(const Key<T>&, T fallback = T()) const noexcept;
+
 	// Get a map of all settings in a section. Returns NULL if not found.
 	unordered_map<string, config::Item>* GetSection(string);
+
+	// Visit every loaded setting with its concatenated "section.key" name.
+	// Visiting order is unspecified.
+	void ForEach(std::function<void(const string&, const config::Item&)>) const;
+
+	// Get a value computed from settings, e.g. a ratio of two limits, or a
+	// set of paths built from several settings:
+	//
+	//   const double& ratio = snapshot->Derive<double>("ratio", {"common.a", "common.b"},
+	//       [](const config::Handler& h) { return ... });
+	//
+	// The function is called with this handler on first use, and its result
+	// is cached under the name until the settings change. After a change,
+	// the result is kept as long as the listed "section.key" dependencies
+	// hash the same, so the function must only read those. The result stays
+	// valid until this handler is changed; snapshots never change, so theirs
+	// last as long as the snapshot. Safe to call concurrently on a const
+	// handler, though racing first uses may each call the function. Throws
+	// if the name was derived as another type.
+	template <typename T, typename Function>
+	const T& Derive(const string&, const vector<string>&, Function) const;
+
+	// Check every later load against a schema, or none if NULL. A load with
+	// settings that break its rules is invalid: Load returns false, and
+	// Reload returns INVALID and keeps the previous settings. An incremental
+	// reload only checks the rules of the sections it changed.
+	void SetSchema(std::shared_ptr<const Schema>);
+
+	// The rules broken by the last invalid load. Empty after a valid one.
+	const vector<SchemaViolation>& GetViolations() const;
+
+	// Take over the values derived by another handler, e.g. the previous
+	// snapshot of the same file, replacing those cached here. Each one is
+	// reused by the next Derive() call if its dependencies did not change.
+	void AdoptDerived(const Handler&);
 };
 
+template <typename T>
+T Handler::Get(const Key<T>& key, T fallback) const noexcept {
+	auto it = keyIndex.find(key.hash);
+	if (it == keyIndex.end()) {
+		return fallback;
+	}
+	const config::Item* item = it->second.item;
+	if (item == NULL) {
+		// Hash collision; resolve by name.
+		item = Find(key.name);
+		if (item == NULL) {
+			return fallback;
+		}
+	} else if (!HasName(it->second.ids, key.name)) {
+		// A missing key with the same hash as a loaded one.
+		return fallback;
+	}
+	assert(KeyReads(Key<T>::type, item->GetValueType()));
+	return ValueTraits<T>::Read(*item);
+}
+
+template <typename T, typename Function>
+const T& Handler::Derive(const string& name, const vector<string>& dependencies, Function compute) const {
+	const void* value = Derive(name, dependencies, typeid(T), [&]() -> std::shared_ptr<const void> {
+		return std::make_shared<const T>(compute(*this));
+	});
+	return *static_cast<const T*>(value);
+}
+
 } // namespace Config
 
 #endif // CONFIG_HANDLER_H_
@@ -0,0 +1,528 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+
+#include "../common/lest.hpp"
+#include "handler.h"
+
+// Keys are declared once, with their hash folded at compile time.
+constexpr config::Key<int64_t> kPaidLimit("common.paid_users_size_limit");
+constexpr config::Key<bool> kFtpEnabled("ftp.enabled");
+constexpr config::Key<std::string_view> kFtpPath("ftp.path");
+constexpr config::Key<config::ListView> kHttpParams("http.params");
+constexpr config::Key<int64_t> kMissing("ftp.foobar123");
+
+static_assert(kPaidLimit.hash == config::HashKey("common.paid_users_size_limit"), "hash must be constexpr");
+
+// Counts every allocation from the global heap, to check what a load costs
+// outside of the resources it was given.
+std::atomic<long> heapAllocations(0);
+
+void* operator new(size_t size) {
+	heapAllocations++;
+	if (void* p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+// Counts allocations passed on to the default resource.
+class CountingResource : public std::pmr::memory_resource {
+	public:
+		int allocations = 0;
+
+	private:
+		void* do_allocate(size_t bytes, size_t alignment) override {
+			allocations++;
+			return std::pmr::get_default_resource()->allocate(bytes, alignment);
+		}
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+			std::pmr::get_default_resource()->deallocate(p, bytes, alignment);
+		}
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+			return this == &other;
+		}
+};
+
+// Replace the contents of a file.
+void WriteFile(const std::string& filename, const std::string& contents) {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	file << contents;
+}
+
+const lest::test specification[] = {
+	CASE("Typed getters return values or fallbacks without throwing") {
+		config::Handler handler;
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}) == true);
+
+		EXPECT(handler.GetInteger("common.paid_users_size_limit", 0) == 2147483648);
+		EXPECT(handler.GetBoolean("ftp.enabled", true) == false);
+		EXPECT(handler.GetString("ftp.path", "") == "/etc/var/uploads");
+
+		// Missing keys return the fallback
+		EXPECT(handler.GetInteger("ftp.foobar123", -1) == -1);
+		EXPECT(handler.Find("ftp.foobar123") == nullptr);
+
+		// Type mismatches return the fallback
+		EXPECT(handler.GetInteger("ftp.path", -1) == -1);
+		EXPECT(handler.GetDouble("common.basic_size_limit", 0.5) == 0.5);
+
+		// List membership
+		EXPECT(handler.Contains("http.params", "array"));
+		EXPECT(!handler.Contains("http.params", "arr"));
+		EXPECT(!handler.Contains("ftp.path", "/etc/var/uploads"));
+		EXPECT(!handler.Contains("ftp.foobar123", int64_t(1)));
+		EXPECT(!handler.ContainsPath("ftp.path", "/etc/var/uploads"));
+
+		// Sizes and durations
+		config::Item timeout;
+		timeout.SetDuration(std::chrono::seconds(30));
+		handler.Set("ftp.timeout", timeout);
+		EXPECT(handler.GetDuration("ftp.timeout", {}) == std::chrono::seconds(30));
+		EXPECT(handler.GetSize("ftp.timeout", -1) == -1);
+		constexpr config::Key<std::chrono::nanoseconds> kTimeout("ftp.timeout");
+		EXPECT(handler.Get(kTimeout) == std::chrono::seconds(30));
+
+		// Integer keys and getters read sizes, so a setting can move to a unit
+		config::Item limit;
+		limit.SetSize(int64_t(25) << 20);
+		handler.Set("ftp.limit", limit);
+		constexpr config::Key<int64_t> kLimit("ftp.limit");
+		EXPECT(handler.Get(kLimit) == int64_t(25) << 20);
+		EXPECT(handler.GetInteger("ftp.limit", -1) == int64_t(25) << 20);
+		EXPECT(handler.GetSize("ftp.limit", -1) == int64_t(25) << 20);
+
+		// Typed lists are empty unless every element has the type
+		EXPECT(handler.GetIntList("http.params").empty());
+		EXPECT(handler.GetBoolList("ftp.foobar123").empty());
+	},
+
+	CASE("Section and key names are interned once") {
+		config::Handler handler;
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}) == true);
+
+		// "path" appears in every section but is stored once
+		const config::Interner& names = handler.GetNames();
+		uint32_t ftp = names.Find("ftp");
+		uint32_t path = names.Find("path");
+		EXPECT(ftp != config::Interner::NOT_FOUND);
+		EXPECT(path != config::Interner::NOT_FOUND);
+		EXPECT(handler.Find(ftp, path) == handler.Find("ftp.path"));
+		EXPECT(handler.Find(ftp, path)->GetString() == "/etc/var/uploads");
+
+		// Override tags that were not requested are never interned
+		EXPECT(names.Find("staging") == config::Interner::NOT_FOUND);
+
+		// Names without a section delimiter are never found
+		EXPECT(handler.Get("ftp") == nullptr);
+	},
+
+	CASE("A handler allocates from the memory resource it is given") {
+		CountingResource counter;
+		{
+			std::pmr::monotonic_buffer_resource arena(&counter);
+			config::Handler handler(&arena);
+			EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}) == true);
+			EXPECT(handler.GetString("ftp.path", "") == "/etc/var/uploads");
+			EXPECT(handler.GetInteger("common.basic_size_limit", 0) == 26214400);
+		}
+		// The load's scratch arena is sized from the file up front, so only
+		// a handful of blocks reach the upstream resource.
+		EXPECT(counter.allocations > 0);
+		EXPECT(counter.allocations < 20);
+	},
+
+	CASE("A reused load context stops allocating after the first load") {
+		CountingResource counter;
+		CountingResource handlerCounter;
+		config::LoadContext context(&counter);
+		config::Handler handler(&handlerCounter);
+
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}, context) == true);
+		int firstLoad = counter.allocations;
+		int firstHandlerLoad = handlerCounter.allocations;
+		EXPECT(firstLoad > 0);
+		const config::Item* path = handler.Find("ftp.path");
+
+		// Reloading the same file reuses the context's buffers and pool, and
+		// merges into the settings in place
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}, context) == true);
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}, context) == true);
+		EXPECT(counter.allocations == firstLoad);
+		EXPECT(handlerCounter.allocations == firstHandlerLoad);
+		EXPECT(handler.Find("ftp.path") == path);
+		EXPECT(handler.GetString("ftp.path", "") == "/etc/var/uploads");
+	},
+
+	CASE("Loading a file again does not copy the settings") {
+		// Short names and values, so that no setting needs a heap string
+		std::string filename = (std::filesystem::temp_directory_path() / "config_merge_test.ini").string();
+		std::string contents;
+		for (int section = 0; section < 10; section++) {
+			contents += "[s" + std::to_string(section) + "]\n";
+			for (int key = 0; key < 50; key++) {
+				contents += "k" + std::to_string(key) + " = " + std::to_string(key) + "\n";
+			}
+		}
+		WriteFile(filename, contents);
+
+		config::LoadContext context;
+		config::Handler handler;
+		EXPECT(handler.Load(filename, {}, context) == true);
+		EXPECT(handler.Load(filename, {}, context) == true);
+
+		// Opening the file allocates a little, but nothing per setting
+		long heapBefore = heapAllocations;
+		EXPECT(handler.Load(filename, {}, context) == true);
+		EXPECT(heapAllocations - heapBefore < 50);
+		EXPECT(handler.GetInteger("s9.k49", 0) == 49);
+		std::filesystem::remove(filename);
+	},
+
+	CASE("Settings can be set at runtime") {
+		config::Handler handler;
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}) == true);
+
+		config::Item item;
+		item.SetString("/srv");
+		handler.Set("ftp.path", item);
+		item.SetInteger(21);
+		handler.Set("ftp.port", item);
+
+		EXPECT(handler.Get(kFtpPath) == "/srv");
+		EXPECT(handler.GetInteger("ftp.port", 0) == 21);
+		EXPECT(handler.GetSection("ftp")->at("port").GetInteger() == 21);
+		EXPECT_THROWS_AS(handler.Set("ftp", item), std::runtime_error);
+	},
+
+	CASE("Typed keys return values of their declared type") {
+		config::Handler handler;
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}) == true);
+
+		EXPECT(handler.Get(kPaidLimit) == 2147483648);
+		EXPECT(handler.Get(kFtpEnabled) == false);
+		EXPECT(handler.Get(kFtpPath) == "/etc/var/uploads");
+		EXPECT(handler.Get(kHttpParams).size() == 3u);
+		EXPECT(handler.Get(kHttpParams)[2] == "values");
+
+		// Missing keys return the fallback
+		EXPECT(handler.Get(kMissing) == 0);
+		EXPECT(handler.Get(kMissing, int64_t(-1)) == -1);
+	},
+
+	CASE("Reload only parses files that changed") {
+		std::string filename = (std::filesystem::temp_directory_path() / "config_reload_test.ini").string();
+		WriteFile(filename, "[ftp]\npath=/a\nold=1\n");
+
+		config::Handler handler;
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.GetString("ftp.path", "") == "/a");
+		EXPECT(handler.GetFingerprint().checksum == config::Crc32c("[ftp]\npath=/a\nold=1\n"));
+
+		// Same stat metadata
+		EXPECT(handler.Reload(filename, {}) == config::UNCHANGED);
+
+		// Touched, but the contents are the same
+		WriteFile(filename, "[ftp]\npath=/a\nold=1\n");
+		auto mtime = std::filesystem::last_write_time(filename);
+		std::filesystem::last_write_time(filename, mtime + std::chrono::seconds(1));
+		EXPECT(handler.Reload(filename, {}) == config::UNCHANGED);
+		EXPECT(handler.Reload(filename, {}) == config::UNCHANGED);
+
+		// Changed; removed keys do not survive
+		WriteFile(filename, "[ftp]\npath=/b\n");
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.GetString("ftp.path", "") == "/b");
+		EXPECT(handler.Find("ftp.old") == nullptr);
+		EXPECT(handler.Get(kFtpPath) == "/b");
+
+		// Invalid files keep the previous settings
+		config::Handler copy = handler;
+		WriteFile(filename, "[ftp]\npath<x>=/c\nbad\n");
+		EXPECT(handler.Reload(filename, {}) == config::INVALID);
+		EXPECT(handler.GetString("ftp.path", "") == "/b");
+
+		// Different overrides reparse the same file
+		WriteFile(filename, "[ftp]\npath=/b\npath<x>=/c\n");
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.Reload(filename, {"x"}) == config::RELOADED);
+		EXPECT(handler.Get(kFtpPath) == "/c");
+
+		// Copies are independent of later reloads
+		EXPECT(copy.Get(kFtpPath) == "/b");
+
+		// Another file with the same contents becomes the loaded file, even
+		// though nothing needs parsing
+		std::string other = (std::filesystem::temp_directory_path() / "config_reload_other.ini").string();
+		WriteFile(other, "[ftp]\npath=/b\npath<x>=/c\n");
+		EXPECT(handler.Reload(other, {"x"}) == config::UNCHANGED);
+		config::Item item;
+		item.SetString("/d");
+		handler.Set("ftp.path", item);
+		handler.Save();
+		std::ifstream saved(other, std::ios::binary);
+		std::string contents((std::istreambuf_iterator<char>(saved)), std::istreambuf_iterator<char>());
+		EXPECT(contents == "[ftp]\npath=/b\npath<x>=\"/d\"\n");
+		EXPECT(handler.Reload(filename, {"x"}) == config::RELOADED);
+		EXPECT(handler.Get(kFtpPath) == "/c");
+		std::filesystem::remove(other);
+
+		std::filesystem::remove(filename);
+		EXPECT_THROWS_AS(handler.Reload(filename, {}), std::runtime_error);
+	},
+
+	CASE("Replay applies another handler's reload without reading the file") {
+		std::string filename = (std::filesystem::temp_directory_path() / "config_replay_test.ini").string();
+		WriteFile(filename, "[ftp]\npath=/a\npath<x>=/x\n[limits]\nlow=1\n");
+
+		config::Handler reloaded;
+		config::Handler twin;
+		config::LoadContext context;
+		EXPECT(reloaded.Reload(filename, {}, context) == config::RELOADED);
+		EXPECT(twin.Replay(reloaded, context) == config::RELOADED);
+		EXPECT(twin.Get(kFtpPath) == "/a");
+
+		// Only the changed section is reparsed, and the file is not read:
+		// it is gone by the time of the replay
+		WriteFile(filename, "[ftp]\npath=/b\npath<x>=/x\n[limits]\nlow=1\n");
+		EXPECT(reloaded.Reload(filename, {}, context) == config::RELOADED);
+		std::filesystem::remove(filename);
+		EXPECT(twin.Replay(reloaded, context) == config::RELOADED);
+		EXPECT(twin.Get(kFtpPath) == "/b");
+		EXPECT(twin.GetInteger("limits.low", 0) == 1);
+		EXPECT(twin.GetFingerprint().checksum == reloaded.GetFingerprint().checksum);
+		EXPECT(twin.Replay(reloaded, context) == config::UNCHANGED);
+
+		// New overrides reparse the whole file
+		WriteFile(filename, "[ftp]\npath=/b\npath<x>=/x\n");
+		EXPECT(reloaded.Reload(filename, {"x"}, context) == config::RELOADED);
+		EXPECT(twin.Replay(reloaded, context) == config::RELOADED);
+		EXPECT(twin.Get(kFtpPath) == "/x");
+		EXPECT(twin.Find("limits.low") == nullptr);
+		std::filesystem::remove(filename);
+	},
+
+	CASE("Reload reparses only the sections that changed") {
+		std::string filename = (std::filesystem::temp_directory_path() / "config_patch_test.ini").string();
+		std::string common = "[common]\nlimit=10\nname=\"a\"\n";
+		std::string ftp = "[ftp]\npath=/a\npath<x>=/x\n";
+		std::string http = "[http]\nparams=a,b\n";
+		WriteFile(filename, "top=1\n" + common + ftp + http);
+
+		config::Handler handler;
+		EXPECT(handler.Reload(filename, {"x"}) == config::RELOADED);
+		const config::Item* limit = handler.Find("common.limit");
+		const config::Item* params = handler.Find("http.params");
+		EXPECT(handler.Get(kFtpPath) == "/x");
+
+		// Change one section, remove one, add one, and repeat one
+		WriteFile(filename, "top=1\n" + common + "[ftp]\npath=/b\n[smtp]\nport=25\n[ftp]\nmode=\"passive\"\n");
+		EXPECT(handler.Reload(filename, {"x"}) == config::RELOADED);
+
+		// Unchanged sections were not reparsed
+		EXPECT(handler.Find("common.limit") == limit);
+		EXPECT(handler.GetInteger("common.limit", 0) == 10);
+		EXPECT(handler.GetInteger(".top", 0) == 1);
+
+		EXPECT(handler.Get(kFtpPath) == "/b");
+		EXPECT(handler.GetString("ftp.mode", "") == "passive");
+		EXPECT(handler.GetInteger("smtp.port", 0) == 25);
+		EXPECT(handler.Find("http.params") == nullptr);
+		EXPECT(handler.Get(kHttpParams).size() == 0u);
+		EXPECT(handler.GetSection("http") == nullptr);
+		EXPECT(handler.GetSection("ftp")->size() == 2u);
+
+		// The result matches a full load of the same file
+		config::Handler full;
+		EXPECT(full.Load(filename, {"x"}) == true);
+		int count = 0;
+		full.ForEach([&](const std::string& key, const config::Item& item) {
+			const config::Item* patched = handler.Find(key);
+			EXPECT(patched != nullptr);
+			EXPECT(patched->GetValueType() == item.GetValueType());
+			count++;
+		});
+		int patchedCount = 0;
+		handler.ForEach([&](const std::string&, const config::Item&) { patchedCount++; });
+		EXPECT(count == patchedCount);
+
+		// An invalid section keeps every previous setting
+		WriteFile(filename, "top=1\n" + common + "[ftp]\nbad\n");
+		EXPECT(handler.Reload(filename, {"x"}) == config::INVALID);
+		EXPECT(handler.Get(kFtpPath) == "/b");
+		EXPECT(handler.GetInteger("smtp.port", 0) == 25);
+
+		std::filesystem::remove(filename);
+	},
+
+	CASE("Save rewrites only the values that were set") {
+		std::string filename = (std::filesystem::temp_directory_path() / "config_save_test.ini").string();
+		std::string copyname = filename + ".copy";
+		WriteFile(filename, "; settings\n[ftp]   ; server\npath = /a   ; uploads\nport=21\n\n[http]\nparams = a,b\n");
+
+		config::Handler handler;
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+
+		config::Item item;
+		item.SetString("/srv/ftp");
+		handler.Set("ftp.path", item);
+		item.SetBoolean(true);
+		handler.Set("ftp.passive", item);
+		item.SetInteger(25);
+		handler.Set("smtp.port", item);
+		handler.Save();
+
+		// Comments, spacing and untouched values are kept as they were
+		std::ifstream file(filename, std::ios::binary);
+		std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		EXPECT(contents == "; settings\n[ftp]   ; server\npath = \"/srv/ftp\"   ; uploads\nport=21\npassive = true\n\n"
+			"[http]\nparams = a,b\n\n[smtp]\nport = 25\n");
+
+		// The handler is in sync with the file it wrote
+		EXPECT(handler.Reload(filename, {}) == config::UNCHANGED);
+		item.SetInteger(2121);
+		handler.Set("ftp.port", item);
+		handler.Save();
+		config::Handler full;
+		EXPECT(full.Load(filename, {}) == true);
+		EXPECT(full.GetInteger("ftp.port", 0) == 2121);
+		EXPECT(full.GetString("ftp.path", "") == "/srv/ftp");
+		EXPECT(full.GetBoolean("ftp.passive", false) == true);
+		EXPECT(full.GetInteger("smtp.port", 0) == 25);
+
+		// Saving elsewhere leaves the loaded file alone
+		item.SetInteger(990);
+		handler.Set("ftp.port", item);
+		handler.Save(copyname);
+		EXPECT(full.Load(copyname, {}) == true);
+		EXPECT(full.GetInteger("ftp.port", 0) == 990);
+		EXPECT(full.Load(filename, {}) == true);
+		EXPECT(full.GetInteger("ftp.port", 0) == 2121);
+
+		// Changes made on disk since the load are not overwritten
+		WriteFile(filename, "[ftp]\nport=1\n");
+		EXPECT_THROWS_AS(handler.Save(), std::runtime_error);
+
+		// Values that cannot be written are rejected before writing
+		config::Handler fresh;
+		item.SetString("say \"hi\"");
+		fresh.Set("ftp.greeting", item);
+		EXPECT_THROWS_AS(fresh.Save(copyname), std::runtime_error);
+		EXPECT_THROWS_AS(fresh.Save(), std::runtime_error);
+
+		std::filesystem::remove(filename);
+		std::filesystem::remove(copyname);
+	},
+
+	CASE("References to other settings are expanded once, and again when they change") {
+		std::string filename = (std::filesystem::temp_directory_path() / "config_interpolation_test.ini").string();
+		std::string ftp = "[ftp]\npath = ${common.path}/ftp\nlimit = ${common.limit}\nnote = \"at ${ftp.path}, max ${ftp.limit}\"\n";
+		std::string http = "[http]\nport = 80\n";
+		WriteFile(filename, ftp + http + "[common]\npath = /srv\nlimit = 25\n");
+
+		config::Handler handler;
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.GetString("ftp.path", "") == "/srv/ftp");
+		EXPECT(handler.GetString("ftp.note", "") == "at /srv/ftp, max 25");
+		EXPECT(handler.GetSection("ftp")->at("path").GetString() == "/srv/ftp");
+
+		// A lone reference keeps the referenced type
+		EXPECT(handler.GetInteger("ftp.limit", 0) == 25);
+
+		// Changing a referenced value reexpands what is downstream of it,
+		// even in sections whose text did not change
+		const config::Item* port = handler.Find("http.port");
+		WriteFile(filename, ftp + http + "[common]\npath = /data\nlimit = 50\n");
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.GetString("ftp.path", "") == "/data/ftp");
+		EXPECT(handler.GetString("ftp.note", "") == "at /data/ftp, max 50");
+		EXPECT(handler.Find("http.port") == port);
+
+		// So does setting one at runtime
+		config::Item item;
+		item.SetString("/mnt");
+		handler.Set("common.path", item);
+		EXPECT(handler.GetString("ftp.note", "") == "at /mnt/ftp, max 50");
+
+		// Missing references and cycles are invalid, and keep the previous settings
+		WriteFile(filename, ftp + http + "[common]\npath = /srv\n");
+		EXPECT(handler.Reload(filename, {}) == config::INVALID);
+		WriteFile(filename, ftp + http + "[common]\npath = ${ftp.path}\nlimit = 25\n");
+		EXPECT(handler.Reload(filename, {}) == config::INVALID);
+		EXPECT(handler.GetString("ftp.path", "") == "/mnt/ftp");
+
+		config::Handler fresh;
+		EXPECT(fresh.Load(filename, {}) == false);
+		WriteFile(filename, "[a]\nb = ${a.c\n");
+		EXPECT(fresh.Load(filename, {}) == false);
+
+		std::filesystem::remove(filename);
+	},
+
+	CASE("Derived values are computed once, and again only when a dependency changes") {
+		std::string filename = (std::filesystem::temp_directory_path() / "config_derive_test.ini").string();
+		WriteFile(filename, "[limits]\nbasic=10\nstudent=25\n[ftp]\npath=/a\n");
+
+		config::Handler handler;
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		int computed = 0;
+		auto ratio = [&](const config::Handler& settings) {
+			computed++;
+			return double(settings.GetInteger("limits.student", 0)) / settings.GetInteger("limits.basic", 1);
+		};
+		const std::vector<std::string> dependencies = {"limits.basic", "limits.student"};
+		EXPECT(handler.Derive<double>("ratio", dependencies, ratio) == 2.5);
+		EXPECT(handler.Derive<double>("ratio", dependencies, ratio) == 2.5);
+		EXPECT(computed == 1);
+
+		// Copies share the value
+		config::Handler copy = handler;
+		EXPECT(copy.Derive<double>("ratio", dependencies, ratio) == 2.5);
+		EXPECT(computed == 1);
+
+		// Changes to other settings keep it
+		WriteFile(filename, "[limits]\nbasic=10\nstudent=25\n[ftp]\npath=/b\n");
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.Derive<double>("ratio", dependencies, ratio) == 2.5);
+		EXPECT(computed == 1);
+
+		// Changes to a dependency recompute it, once
+		config::Item item;
+		item.SetInteger(20);
+		handler.Set("limits.basic", item);
+		EXPECT(handler.Derive<double>("ratio", dependencies, ratio) == 1.25);
+		EXPECT(handler.Derive<double>("ratio", dependencies, ratio) == 1.25);
+		EXPECT(computed == 2);
+		EXPECT(copy.Derive<double>("ratio", dependencies, ratio) == 2.5);
+
+		// A full reparse keeps them too
+		EXPECT(handler.Reload(filename, {"x"}) == config::RELOADED);
+		EXPECT(handler.Derive<double>("ratio", dependencies, ratio) == 2.5);
+		EXPECT(computed == 3);
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.Derive<double>("ratio", dependencies, ratio) == 2.5);
+		EXPECT(computed == 3);
+
+		EXPECT_THROWS_AS(handler.Derive<int>("ratio", dependencies, [](const config::Handler&) { return 0; }), std::runtime_error);
+
+		std::filesystem::remove(filename);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -0,0 +1,304 @@
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "errors.h"
+#include "image.h"
+#include "key.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+namespace {
+
+const uint32_t EMPTY = UINT32_MAX;
+
+// Round a byte count up to whole 8-byte words.
+uint64_t AlignUp(uint64_t bytes) {
+	return (bytes + 7) & ~uint64_t(7);
+}
+
+// Append a string to an arena and return where it was placed.
+Span AppendString(string& arena, std::string_view in) {
+	// Spans are 32-bit to keep the arrays dense, so refuse arenas that
+	// would not be addressable.
+	if (arena.size() + in.size() > std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error(errors::STORE_MAX_SIZE);
+	}
+	Span span;
+	span.offset = static_cast<uint32_t>(arena.size());
+	span.length = static_cast<uint32_t>(in.size());
+	arena.append(in.data(), in.size());
+	return span;
+}
+
+// True if a span lies within a region of the given length.
+bool SpanFits(const Span& span, uint64_t length) {
+	return static_cast<uint64_t>(span.offset) + span.length <= length;
+}
+
+} // namespace
+
+Image::Image()
+	: header(NULL),
+	  table(NULL),
+	  types(NULL),
+	  scalars(NULL),
+	  spans(NULL),
+	  keySpans(NULL),
+	  listSpans(NULL),
+	  arena(NULL) {}
+
+void Image::Build(const Handler& handler, uint64_t generation, vector<uint64_t>& out) {
+	vector<uint8_t> types;
+	vector<uint64_t> scalars;
+	vector<Span> spans;
+	vector<Span> keySpans;
+	vector<Span> listSpans;
+	string arena;
+
+	handler.ForEach([&](const string& key, const config::Item& item) {
+		ValueType type = item.GetValueType();
+
+		// Every slot gets an entry in each array so that they stay parallel.
+		uint64_t scalar = 0;
+		Span span = {0, 0};
+		switch (type) {
+			case ValueType::STRING:
+			span = AppendString(arena, item.GetStringView());
+			break;
+
+			case ValueType::BOOLEAN:
+			scalar = item.GetBoolean() ? 1 : 0;
+			break;
+
+			case ValueType::INTEGER: {
+			int64_t intValue = item.GetInteger();
+			std::memcpy(&scalar, &intValue, sizeof(scalar));
+			break;
+			}
+
+			case ValueType::SIZE: {
+			int64_t bytes = item.GetSize();
+			std::memcpy(&scalar, &bytes, sizeof(scalar));
+			break;
+			}
+
+			case ValueType::DURATION: {
+			int64_t nanoseconds = item.GetDuration().count();
+			std::memcpy(&scalar, &nanoseconds, sizeof(scalar));
+			break;
+			}
+
+			case ValueType::DOUBLE: {
+			double doubleValue = item.GetDouble();
+			std::memcpy(&scalar, &doubleValue, sizeof(scalar));
+			break;
+			}
+
+			case ValueType::LIST: {
+			ListView list = item.GetListView();
+			span.offset = static_cast<uint32_t>(listSpans.size());
+			span.length = static_cast<uint32_t>(list.size());
+			for (const auto& element : list) {
+				listSpans.push_back(AppendString(arena, element));
+			}
+			break;
+			}
+		}
+
+		types.push_back(static_cast<uint8_t>(type));
+		scalars.push_back(scalar);
+		spans.push_back(span);
+		keySpans.push_back(AppendString(arena, key));
+	});
+
+	// Keep the table at most half full.
+	uint32_t count = static_cast<uint32_t>(types.size());
+	uint32_t tableSize = 16;
+	while (tableSize < count * 2) {
+		tableSize *= 2;
+	}
+	vector<uint32_t> table(tableSize, EMPTY);
+	for (uint32_t slot = 0; slot < count; slot++) {
+		std::string_view key(arena.data() + keySpans[slot].offset, keySpans[slot].length);
+		size_t i = MixHash(HashKey(key)) & (tableSize - 1);
+		while (table[i] != EMPTY) {
+			i = (i + 1) & (tableSize - 1);
+		}
+		table[i] = slot;
+	}
+
+	// Lay out each region after the header, aligned to 8 bytes.
+	ImageHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = IMAGE_MAGIC;
+	header.version = IMAGE_VERSION;
+	header.count = count;
+	header.tableSize = tableSize;
+	header.listCount = static_cast<uint32_t>(listSpans.size());
+	header.generation = generation;
+	header.arenaSize = arena.size();
+	uint64_t offset = AlignUp(sizeof(ImageHeader));
+	header.tableOffset = offset;
+	offset += AlignUp(table.size() * sizeof(uint32_t));
+	header.typesOffset = offset;
+	offset += AlignUp(types.size());
+	header.scalarsOffset = offset;
+	offset += AlignUp(scalars.size() * sizeof(uint64_t));
+	header.spansOffset = offset;
+	offset += AlignUp(spans.size() * sizeof(Span));
+	header.keySpansOffset = offset;
+	offset += AlignUp(keySpans.size() * sizeof(Span));
+	header.listSpansOffset = offset;
+	offset += AlignUp(listSpans.size() * sizeof(Span));
+	header.arenaOffset = offset;
+	offset += AlignUp(arena.size());
+	header.size = offset;
+
+	out.assign(offset / sizeof(uint64_t), 0);
+	char* base = reinterpret_cast<char*>(out.data());
+	std::memcpy(base, &header, sizeof(header));
+	std::memcpy(base + header.tableOffset, table.data(), table.size() * sizeof(uint32_t));
+	std::memcpy(base + header.typesOffset, types.data(), types.size());
+	std::memcpy(base + header.scalarsOffset, scalars.data(), scalars.size() * sizeof(uint64_t));
+	std::memcpy(base + header.spansOffset, spans.data(), spans.size() * sizeof(Span));
+	std::memcpy(base + header.keySpansOffset, keySpans.data(), keySpans.size() * sizeof(Span));
+	std::memcpy(base + header.listSpansOffset, listSpans.data(), listSpans.size() * sizeof(Span));
+	std::memcpy(base + header.arenaOffset, arena.data(), arena.size());
+}
+
+bool Image::Attach(const void* data, size_t size) {
+	*this = Image();
+	if (data == NULL || size < sizeof(ImageHeader) || reinterpret_cast<uintptr_t>(data) % 8 != 0) {
+		return false;
+	}
+	const char* base = static_cast<const char*>(data);
+	const ImageHeader* candidate = reinterpret_cast<const ImageHeader*>(base);
+	if (candidate->magic != IMAGE_MAGIC || candidate->version != IMAGE_VERSION || candidate->size > size) {
+		return false;
+	}
+
+	// Every region must be aligned and lie within the image.
+	uint64_t count = candidate->count;
+	uint64_t tableSize = candidate->tableSize;
+	struct Region {
+		uint64_t offset;
+		uint64_t length;
+	} regions[] = {
+		{candidate->tableOffset, tableSize * sizeof(uint32_t)},
+		{candidate->typesOffset, count},
+		{candidate->scalarsOffset, count * sizeof(uint64_t)},
+		{candidate->spansOffset, count * sizeof(Span)},
+		{candidate->keySpansOffset, count * sizeof(Span)},
+		{candidate->listSpansOffset, candidate->listCount * sizeof(Span)},
+		{candidate->arenaOffset, candidate->arenaSize},
+	};
+	for (const Region& region : regions) {
+		if (region.offset % 8 != 0 || region.offset > candidate->size ||
+			region.length > candidate->size - region.offset) {
+			return false;
+		}
+	}
+	if (tableSize == 0 || (tableSize & (tableSize - 1)) != 0 || tableSize < count * 2) {
+		return false;
+	}
+
+	// Check every reference, so that lookups never leave the image.
+	const uint32_t* candidateTable = reinterpret_cast<const uint32_t*>(base + candidate->tableOffset);
+	const uint8_t* candidateTypes = reinterpret_cast<const uint8_t*>(base + candidate->typesOffset);
+	const Span* candidateSpans = reinterpret_cast<const Span*>(base + candidate->spansOffset);
+	const Span* candidateKeySpans = reinterpret_cast<const Span*>(base + candidate->keySpansOffset);
+	const Span* candidateListSpans = reinterpret_cast<const Span*>(base + candidate->listSpansOffset);
+	// Find stops probing at the first free entry, so a table without one,
+	// e.g. with the same slot written over and over, would never let it.
+	uint64_t free = 0;
+	for (uint64_t i = 0; i < tableSize; i++) {
+		if (candidateTable[i] == EMPTY) {
+			free++;
+		} else if (candidateTable[i] >= count) {
+			return false;
+		}
+	}
+	if (free == 0) {
+		return false;
+	}
+	for (uint64_t slot = 0; slot < count; slot++) {
+		if (!SpanFits(candidateKeySpans[slot], candidate->arenaSize)) {
+			return false;
+		}
+		switch (candidateTypes[slot]) {
+			case ValueType::STRING:
+			if (!SpanFits(candidateSpans[slot], candidate->arenaSize)) {
+				return false;
+			}
+			break;
+
+			case ValueType::LIST:
+			if (!SpanFits(candidateSpans[slot], candidate->listCount)) {
+				return false;
+			}
+			break;
+
+			case ValueType::BOOLEAN:
+			case ValueType::INTEGER:
+			case ValueType::DOUBLE:
+			case ValueType::SIZE:
+			case ValueType::DURATION:
+			break;
+
+			default:
+			return false;
+		}
+	}
+	for (uint64_t i = 0; i < candidate->listCount; i++) {
+		if (!SpanFits(candidateListSpans[i], candidate->arenaSize)) {
+			return false;
+		}
+	}
+
+	header = candidate;
+	table = candidateTable;
+	types = candidateTypes;
+	scalars = reinterpret_cast<const uint64_t*>(base + candidate->scalarsOffset);
+	spans = candidateSpans;
+	keySpans = candidateKeySpans;
+	listSpans = candidateListSpans;
+	arena = base + candidate->arenaOffset;
+	return true;
+}
+
+uint32_t Image::Find(std::string_view key) const {
+	if (header == NULL) {
+		return NOT_FOUND;
+	}
+	size_t mask = header->tableSize - 1;
+	size_t i = MixHash(HashKey(key)) & mask;
+	// Linear probing; the table is never full, so this terminates.
+	while (table[i] != EMPTY) {
+		if (Key(table[i]) == key) {
+			return table[i];
+		}
+		i = (i + 1) & mask;
+	}
+	return NOT_FOUND;
+}
+
+std::string_view Image::Key(uint32_t slot) const {
+	const Span& span = keySpans[slot];
+	return std::string_view(arena + span.offset, span.length);
+}
+
+size_t Image::Size() const {
+	return header == NULL ? 0 : header->count;
+}
+
+uint64_t Image::Generation() const {
+	return header == NULL ? 0 : header->generation;
+}
+
+} // namespace config
@@ -0,0 +1,116 @@
+/*
+ * An Image is a frozen config laid out in one contiguous block of memory:
+ * a header, a hash table of keys, parallel arrays of items and a string
+ * arena. Every reference inside the block is an offset from its start, so an
+ * image can be copied, written to a file or mapped into shared memory at any
+ * address and read in place.
+ */
+
+#ifndef CONFIG_IMAGE_H_
+#define CONFIG_IMAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "handler.h"
+#include "views.h"
+
+namespace config {
+
+// For readability
+using std::vector;
+
+// The first bytes of every image.
+struct ImageHeader {
+	// IMAGE_MAGIC and IMAGE_VERSION.
+	uint64_t magic;
+	uint32_t version;
+
+	// Number of items, and of slots in the hash table (a power of two).
+	uint32_t count;
+	uint32_t tableSize;
+	uint32_t listCount;
+
+	// Set by whoever publishes the image, e.g. a shared memory generation.
+	uint64_t generation;
+
+	// Size of the whole image, and of the string arena at its end.
+	uint64_t size;
+	uint64_t arenaSize;
+
+	// Offsets of each region from the start of the image.
+	uint64_t tableOffset;
+	uint64_t typesOffset;
+	uint64_t scalarsOffset;
+	uint64_t spansOffset;
+	uint64_t keySpansOffset;
+	uint64_t listSpansOffset;
+	uint64_t arenaOffset;
+};
+
+class ItemView;
+
+class Image {
+  private:
+	friend class ItemView;
+
+	const ImageHeader* header;
+
+	// Open-addressing hash table of slots, probed linearly from the mixed
+	// hash of the key. EMPTY marks free entries.
+	const uint32_t* table;
+
+	// Parallel arrays, one entry per item, indexed by slot.
+	// Integers, booleans and doubles are stored inline in scalars; strings
+	// are described by a span into the arena, and lists by a span into
+	// listSpans.
+	const uint8_t* types;
+	const uint64_t* scalars;
+	const Span* spans;
+
+	// The "section.key" name of each item, as a span into the arena.
+	const Span* keySpans;
+
+	// Spans of every list element, referenced by a list item's span.
+	const Span* listSpans;
+
+	// Every name, string and list element, stored back to back.
+	const char* arena;
+
+  public:
+	static constexpr uint64_t IMAGE_MAGIC = 0x31474D49474643ULL; // "CFGIMG1"
+	static constexpr uint32_t IMAGE_VERSION = 1;
+
+	// Returned by Find for keys that are not in the image.
+	static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+	// An empty image that finds nothing.
+	Image();
+
+	// Freeze every setting currently loaded in a Handler into an image. The
+	// buffer is made of 8-byte words so that every region is aligned.
+	static void Build(const Handler&, uint64_t generation, vector<uint64_t>&);
+
+	// Read an image in place. Checks the header and that every offset stays
+	// within the given size, and returns false if not, leaving this image
+	// empty. The memory must stay mapped for as long as this image is used.
+	bool Attach(const void*, size_t);
+
+	// The slot of a "section.key" setting, or NOT_FOUND.
+	uint32_t Find(std::string_view) const;
+
+	// The "section.key" name of a slot.
+	std::string_view Key(uint32_t) const;
+
+	// Number of items.
+	size_t Size() const;
+
+	// The generation the image was built with.
+	uint64_t Generation() const;
+};
+
+} // namespace config
+
+#endif // CONFIG_IMAGE_H_
@@ -0,0 +1,87 @@
+#include <stdexcept>
+
+#include "errors.h"
+#include "interner.h"
+#include "key.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+namespace {
+
+const uint32_t EMPTY = UINT32_MAX;
+
+} // namespace
+
+size_t Interner::Probe(std::string_view name) const {
+	size_t mask = slots.size() - 1;
+	size_t i = MixHash(HashKey(name)) & mask;
+	// Linear probing; the table is never full, so this terminates.
+	while (slots[i] != EMPTY && Name(slots[i]) != name) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+void Interner::Grow() {
+	size_t size = slots.empty() ? 16 : slots.size() * 2;
+	slots.assign(size, EMPTY);
+	for (uint32_t id = 0; id < names.size(); id++) {
+		slots[Probe(Name(id))] = id;
+	}
+}
+
+uint32_t Interner::Intern(std::string_view name) {
+	if (slots.empty()) {
+		Grow();
+	}
+	size_t i = Probe(name);
+	if (slots[i] != EMPTY) {
+		return slots[i];
+	}
+
+	// IDs and offsets are 32-bit; NOT_FOUND is reserved.
+	if (names.size() >= NOT_FOUND - 1 || arena.size() + name.size() > UINT32_MAX) {
+		throw std::runtime_error(errors::INTERNER_MAX_SIZE);
+	}
+	uint32_t id = static_cast<uint32_t>(names.size());
+	Span span;
+	span.offset = static_cast<uint32_t>(arena.size());
+	span.length = static_cast<uint32_t>(name.size());
+	arena.append(name.data(), name.size());
+	names.push_back(span);
+	slots[i] = id;
+
+	if (names.size() * 2 > slots.size()) {
+		Grow();
+	}
+	return id;
+}
+
+uint32_t Interner::Find(std::string_view name) const {
+	if (slots.empty()) {
+		return NOT_FOUND;
+	}
+	uint32_t id = slots[Probe(name)];
+	return id == EMPTY ? NOT_FOUND : id;
+}
+
+std::string_view Interner::Name(uint32_t id) const {
+	const Span& span = names[id];
+	return std::string_view(arena.data() + span.offset, span.length);
+}
+
+size_t Interner::Size() const {
+	return names.size();
+}
+
+void Interner::Clear() {
+	arena.clear();
+	names.clear();
+	slots.clear();
+}
+
+} // namespace config
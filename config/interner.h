@@ -0,0 +1,62 @@
+/*
+ * An Interner object maps distinct names (sections, keys, override tags) to
+ * dense 32-bit IDs, storing each name exactly once in a single arena.
+ */
+
+#ifndef CONFIG_INTERNER_H_
+#define CONFIG_INTERNER_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "views.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+class Interner {
+  private:
+	// Every interned name, back to back.
+	string arena;
+
+	// The span of each name in the arena, indexed by ID.
+	vector<Span> names;
+
+	// Open-addressing hash table of IDs. EMPTY marks free slots. The size is
+	// always a power of two and kept at most half full.
+	vector<uint32_t> slots;
+
+	// Find the slot holding a name, or the empty slot where it would go.
+	size_t Probe(std::string_view) const;
+
+	// Double the table and re-insert every ID.
+	void Grow();
+
+  public:
+	// Returned by Find for names that were never interned.
+	static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+	// Get the ID of a name, interning it if it is new.
+	uint32_t Intern(std::string_view);
+
+	// Get the ID of a name without interning it. Returns NOT_FOUND if missing.
+	uint32_t Find(std::string_view) const;
+
+	// Get the name of an ID. The view is valid until the next Intern call.
+	std::string_view Name(uint32_t) const;
+
+	// Number of distinct names.
+	size_t Size() const;
+
+	// Forget every name.
+	void Clear();
+};
+
+} // namespace config
+
+#endif // CONFIG_INTERNER_H_
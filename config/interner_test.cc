@@ -0,0 +1,56 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "../common/lest.hpp"
+#include "interner.h"
+
+const lest::test specification[] = {
+	CASE("Each distinct name gets one dense ID") {
+		config::Interner names;
+
+		uint32_t common = names.Intern("common");
+		uint32_t path = names.Intern("path");
+		EXPECT(common == 0u);
+		EXPECT(path == 1u);
+		EXPECT(names.Intern("common") == common);
+		EXPECT(names.Size() == 2u);
+
+		EXPECT(names.Name(common) == "common");
+		EXPECT(names.Name(path) == "path");
+
+		// The empty name is a valid name
+		uint32_t empty = names.Intern("");
+		EXPECT(names.Name(empty) == "");
+		EXPECT(names.Find("") == empty);
+	},
+
+	CASE("Find does not intern") {
+		config::Interner names;
+		EXPECT(names.Find("common") == config::Interner::NOT_FOUND);
+		EXPECT(names.Size() == 0u);
+
+		names.Intern("common");
+		EXPECT(names.Find("common") == 0u);
+		EXPECT(names.Find("http") == config::Interner::NOT_FOUND);
+	},
+
+	CASE("IDs survive the table growing") {
+		config::Interner names;
+		for (int i = 0; i < 10000; i++) {
+			EXPECT(names.Intern("key" + std::to_string(i)) == static_cast<uint32_t>(i));
+		}
+		for (int i = 0; i < 10000; i++) {
+			EXPECT(names.Find("key" + std::to_string(i)) == static_cast<uint32_t>(i));
+		}
+		EXPECT(names.Name(1234) == "key1234");
+
+		names.Clear();
+		EXPECT(names.Size() == 0u);
+		EXPECT(names.Find("key1") == config::Interner::NOT_FOUND);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
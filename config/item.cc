@@ -1,14 +1,77 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <functional>
 #include <stdexcept>
 
 #include "item.h"
+#include "key.h"
 
 namespace config {
 
-ValueType Item::GetValueType() {
+// A hash table of the positions of a list's elements, with open addressing
+// and linear probing, and the elements that read as integers, sorted.
+struct ListIndex {
+	// Element position plus one, or 0 for an empty slot.
+	std::vector<uint32_t> slots;
+	uint64_t mask;
+	std::vector<int64_t> integers;
+};
+
+// The parsed elements of a list whose elements are all of one type. Only
+// the array of that type is filled.
+struct ListValues {
+	std::vector<int64_t> integers;
+	std::vector<double> doubles;
+	std::unique_ptr<bool[]> booleans;
+};
+
+namespace {
+
+// Read a whole list element as an integer.
+bool ReadInteger(std::string_view element, int64_t& value) {
+	const char* end = element.data() + element.size();
+	std::from_chars_result result = std::from_chars(element.data(), end, value);
+	return result.ec == std::errc() && result.ptr == end && !element.empty();
+}
+
+// The type a list element would have as a single value: a number is an
+// optional minus sign followed by digits and at most one decimal point, and
+// a boolean is yes, true, no or false. Numbers out of range are strings.
+ValueType ElementType(std::string_view element) {
+	if (element == "yes" || element == "true" || element == "no" || element == "false") {
+		return ValueType::BOOLEAN;
+	}
+	size_t start = !element.empty() && element[0] == '-' ? 1 : 0;
+	size_t decimals = 0;
+	for (size_t i = start; i < element.size(); i++) {
+		if (element[i] == '.') {
+			decimals++;
+		} else if (!std::isdigit(static_cast<unsigned char>(element[i]))) {
+			return ValueType::STRING;
+		}
+	}
+	if (decimals > 1) {
+		return ValueType::STRING;
+	}
+	const char* end = element.data() + element.size();
+	if (decimals == 1) {
+		double value = 0;
+		std::from_chars_result result = std::from_chars(element.data(), end, value);
+		return result.ec == std::errc() && result.ptr == end ? ValueType::DOUBLE : ValueType::STRING;
+	}
+	int64_t value = 0;
+	return ReadInteger(element, value) ? ValueType::INTEGER : ValueType::STRING;
+}
+
+} // namespace
+
+ValueType Item::GetValueType() const {
 	return valueType;
 }
 
-std::string Item::GetString() {
+std::string Item::GetString() const {
 	if (valueType != ValueType::STRING) {
 		// Note: to be tolerant, we could permit returning string for
 		// all types as string is the base type. But this invalidates
@@ -18,57 +81,351 @@ std::string Item::GetString() {
 	return stringValue;
 }
 
-bool Item::GetBoolean() {
+bool Item::GetBoolean() const {
 	if (valueType != ValueType::BOOLEAN) {
 		throw std::runtime_error(errors::TYPE_MISMATCH);
 	}
 	return booleanValue;
 }
 
-int64_t Item::GetInteger() {
+int64_t Item::GetInteger() const {
 	if (valueType != ValueType::INTEGER) {
 		throw std::runtime_error(errors::TYPE_MISMATCH);
 	}
 	return integerValue;
 }
 
-double Item::GetDouble() {
+double Item::GetDouble() const {
 	if (valueType != ValueType::DOUBLE) {
 		throw std::runtime_error(errors::TYPE_MISMATCH);
 	}
 	return doubleValue;
 }
 
-std::vector<std::string> Item::GetList() {
+int64_t Item::GetSize() const {
+	if (valueType != ValueType::SIZE) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return integerValue;
+}
+
+std::chrono::nanoseconds Item::GetDuration() const {
+	if (valueType != ValueType::DURATION) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return std::chrono::nanoseconds(integerValue);
+}
+
+std::vector<std::string> Item::GetList() const {
 	if (valueType != ValueType::LIST) {
 		throw std::runtime_error(errors::TYPE_MISMATCH);
 	}
-	return listValue;
+	std::vector<std::string> out;
+	out.reserve(listSpans.size());
+	for (const auto& span : listSpans) {
+		out.push_back(listArena.substr(span.offset, span.length));
+	}
+	return out;
+}
+
+ValueType Item::GetListType() const {
+	if (valueType != ValueType::LIST) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return listType;
+}
+
+ArrayView<int64_t> Item::GetIntList() const {
+	if (valueType != ValueType::LIST || listType != ValueType::INTEGER) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return ArrayView<int64_t>(listValues->integers.data(), listValues->integers.size());
+}
+
+ArrayView<double> Item::GetDoubleList() const {
+	if (valueType != ValueType::LIST || listType != ValueType::DOUBLE) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return ArrayView<double>(listValues->doubles.data(), listValues->doubles.size());
+}
+
+ArrayView<bool> Item::GetBoolList() const {
+	if (valueType != ValueType::LIST || listType != ValueType::BOOLEAN) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return ArrayView<bool>(listValues->booleans.get(), listSpans.size());
+}
+
+std::string_view Item::GetStringView() const {
+	if (valueType != ValueType::STRING) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return stringValue;
+}
+
+ListView Item::GetListView() const {
+	if (valueType != ValueType::LIST) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return ListView(listArena.data(), listSpans.data(), listSpans.size());
 }
 
 void Item::SetString(std::string in) {
 	valueType = ValueType::STRING;
 	stringValue = in;
+	Rehash();
 }
 
 void Item::SetBoolean(bool in) {
 	valueType = ValueType::BOOLEAN;
 	booleanValue = in;
+	Rehash();
 }
 
 void Item::SetInteger(int64_t in) {
 	valueType = ValueType::INTEGER;
 	integerValue = in;
+	Rehash();
 }
 
 void Item::SetDouble(double in) {
 	valueType = ValueType::DOUBLE;
 	doubleValue = in;
+	Rehash();
+}
+
+void Item::SetSize(int64_t in) {
+	valueType = ValueType::SIZE;
+	integerValue = in;
+	Rehash();
+}
+
+void Item::SetDuration(std::chrono::nanoseconds in) {
+	valueType = ValueType::DURATION;
+	integerValue = in.count();
+	Rehash();
 }
 
 void Item::SetList(std::vector<std::string> in) {
 	valueType = ValueType::LIST;
-	listValue = in;
+	listArena.clear();
+	listSpans.clear();
+	listSpans.reserve(in.size());
+	for (const auto& element : in) {
+		AppendListElement(element);
+	}
+	TypeList();
+	IndexList();
+	Rehash();
+}
+
+void Item::SetList(ListView in) {
+	// A view of this item's own list, as in item.SetList(item.GetListView()),
+	// would be overwritten while it is read, so copy it out first.
+	std::less<const char*> before;
+	const char* arenaEnd = listArena.data() + listArena.size();
+	for (const auto& element : in) {
+		if (!before(element.data(), listArena.data()) && !before(arenaEnd, element.data())) {
+			std::vector<std::string> copy;
+			copy.reserve(in.size());
+			for (const auto& e : in) {
+				copy.emplace_back(e);
+			}
+			SetList(std::move(copy));
+			return;
+		}
+	}
+
+	valueType = ValueType::LIST;
+	listArena.clear();
+	listSpans.clear();
+	listSpans.reserve(in.size());
+	for (const auto& element : in) {
+		AppendListElement(element);
+	}
+	TypeList();
+	IndexList();
+	Rehash();
+}
+
+void Item::TypeList() {
+	listType = ValueType::STRING;
+	listValues.reset();
+	if (listSpans.empty()) {
+		return;
+	}
+	std::string_view first(listArena.data() + listSpans[0].offset, listSpans[0].length);
+	ValueType type = ElementType(first);
+	for (size_t i = 1; i < listSpans.size() && type != ValueType::STRING; i++) {
+		ValueType next = ElementType(std::string_view(listArena.data() + listSpans[i].offset, listSpans[i].length));
+		if (next == type) {
+			continue;
+		}
+		bool numbers = (next == ValueType::INTEGER || next == ValueType::DOUBLE)
+			&& (type == ValueType::INTEGER || type == ValueType::DOUBLE);
+		type = numbers ? ValueType::DOUBLE : ValueType::STRING;
+	}
+	if (type == ValueType::STRING) {
+		return;
+	}
+
+	// Every element was checked above, so none of these fail.
+	auto values = std::make_shared<ListValues>();
+	if (type == ValueType::BOOLEAN) {
+		values->booleans.reset(new bool[listSpans.size()]);
+	} else if (type == ValueType::INTEGER) {
+		values->integers.reserve(listSpans.size());
+	} else {
+		values->doubles.reserve(listSpans.size());
+	}
+	for (size_t i = 0; i < listSpans.size(); i++) {
+		const char* begin = listArena.data() + listSpans[i].offset;
+		const char* end = begin + listSpans[i].length;
+		if (type == ValueType::INTEGER) {
+			int64_t value = 0;
+			std::from_chars(begin, end, value);
+			values->integers.push_back(value);
+		} else if (type == ValueType::DOUBLE) {
+			double value = 0;
+			std::from_chars(begin, end, value);
+			values->doubles.push_back(value);
+		} else {
+			std::string_view element(begin, end - begin);
+			values->booleans[i] = element == "yes" || element == "true";
+		}
+	}
+	listType = type;
+	listValues = std::move(values);
+}
+
+void Item::IndexList() {
+	listIndex.reset();
+	if (listSpans.size() < LIST_INDEX_MIN) {
+		return;
+	}
+	auto index = std::make_shared<ListIndex>();
+
+	// At most half full, so that probes stay short.
+	size_t capacity = 1;
+	while (capacity < listSpans.size() * 2) {
+		capacity <<= 1;
+	}
+	index->slots.assign(capacity, 0);
+	index->mask = capacity - 1;
+	for (uint32_t i = 0; i < listSpans.size(); i++) {
+		std::string_view element(listArena.data() + listSpans[i].offset, listSpans[i].length);
+		uint64_t slot = config::MixHash(config::HashKey(element)) & index->mask;
+		while (index->slots[slot] != 0) {
+			slot = (slot + 1) & index->mask;
+		}
+		index->slots[slot] = i + 1;
+
+		int64_t value = 0;
+		if (ReadInteger(element, value)) {
+			index->integers.push_back(value);
+		}
+	}
+	std::sort(index->integers.begin(), index->integers.end());
+	listIndex = std::move(index);
+}
+
+bool Item::HasElement(std::string_view value) const noexcept {
+	if (listIndex == nullptr) {
+		for (const auto& span : listSpans) {
+			if (std::string_view(listArena.data() + span.offset, span.length) == value) {
+				return true;
+			}
+		}
+		return false;
+	}
+	const ListIndex& index = *listIndex;
+	for (uint64_t slot = config::MixHash(config::HashKey(value)) & index.mask; index.slots[slot] != 0; slot = (slot + 1) & index.mask) {
+		const Span& span = listSpans[index.slots[slot] - 1];
+		if (std::string_view(listArena.data() + span.offset, span.length) == value) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Item::Contains(std::string_view value) const noexcept {
+	return valueType == ValueType::LIST && HasElement(value);
+}
+
+bool Item::Contains(int64_t value) const noexcept {
+	if (valueType != ValueType::LIST) {
+		return false;
+	}
+	if (listIndex != nullptr) {
+		return std::binary_search(listIndex->integers.begin(), listIndex->integers.end(), value);
+	}
+	for (const auto& span : listSpans) {
+		int64_t element = 0;
+		if (ReadInteger(std::string_view(listArena.data() + span.offset, span.length), element) && element == value) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Item::ContainsPath(std::string_view path) const noexcept {
+	if (valueType != ValueType::LIST || path.empty()) {
+		return false;
+	}
+	// The path itself, and each directory above it, with and without its
+	// trailing slash.
+	if (HasElement(path)) {
+		return true;
+	}
+	for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+		if ((slash > 0 && HasElement(path.substr(0, slash))) || HasElement(path.substr(0, slash + 1))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Item::AppendListElement(std::string_view element) {
+	Span span;
+	span.offset = static_cast<uint32_t>(listArena.size());
+	span.length = static_cast<uint32_t>(element.size());
+	listArena.append(element);
+	listSpans.push_back(span);
+}
+
+uint64_t Item::Hash() const {
+	return hash;
+}
+
+void Item::Rehash() {
+	// Seed with the type, so that e.g. the integer 1 and the boolean true differ.
+	uint64_t seed = config::FNV_OFFSET_BASIS ^ static_cast<uint64_t>(valueType);
+	char bytes[sizeof(int64_t)];
+	switch (valueType) {
+		case ValueType::STRING:
+			hash = config::HashKey(stringValue, seed);
+			break;
+		case ValueType::BOOLEAN:
+			hash = config::HashKey(booleanValue ? "1" : "0", seed);
+			break;
+		case ValueType::INTEGER:
+		case ValueType::SIZE:
+		case ValueType::DURATION:
+			std::memcpy(bytes, &integerValue, sizeof(bytes));
+			hash = config::HashKey(std::string_view(bytes, sizeof(bytes)), seed);
+			break;
+		case ValueType::DOUBLE:
+			std::memcpy(bytes, &doubleValue, sizeof(bytes));
+			hash = config::HashKey(std::string_view(bytes, sizeof(bytes)), seed);
+			break;
+		case ValueType::LIST:
+			// The spans delimit the elements, so ["ab", "c"] and ["a", "bc"] differ.
+			hash = config::HashKey(listArena, seed);
+			hash = config::HashKey(std::string_view(reinterpret_cast<const char*>(listSpans.data()),
+				listSpans.size() * sizeof(Span)), hash);
+			break;
+	}
+	hash = config::MixHash(hash);
 }
 
 } // namespace config
@@ -5,47 +5,233 @@
 #ifndef CONFIG_ITEM_H_
 #define CONFIG_ITEM_H_
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string_view>
 #include <vector>
 
 #include "errors.h"
+#include "views.h"
 
 namespace config {
 
-// The different types supported by a config item.
+// The different types supported by a config item. Sizes are a number of
+// bytes and durations a number of nanoseconds, written with a unit suffix.
 enum ValueType {
 	STRING,
 	BOOLEAN,
 	INTEGER,
 	DOUBLE,
-	LIST
+	LIST,
+	SIZE,
+	DURATION
 };
 
+template <typename T>
+struct ValueTraits;
+
+struct ListIndex;
+struct ListValues;
+
 // A single configuration item with its value type.
 class Item {
 	public:
-		ValueType GetValueType();
-		std::string GetString();
-		bool GetBoolean();
-		int64_t GetInteger();
-		double GetDouble();
-		std::vector<std::string> GetList();
+		ValueType GetValueType() const;
+		std::string GetString() const;
+		bool GetBoolean() const;
+		int64_t GetInteger() const;
+		double GetDouble() const;
+		std::vector<std::string> GetList() const;
+		int64_t GetSize() const;
+		std::chrono::nanoseconds GetDuration() const;
+
+		// Allocation-free accessors. The returned views point into this item
+		// and are only valid while it is alive and unmodified.
+		std::string_view GetStringView() const;
+		ListView GetListView() const;
+
+		// The type of every element of a list: INTEGER, DOUBLE or BOOLEAN if
+		// each element reads as one, by the same rules as a single value, and
+		// STRING otherwise. Integers and doubles mixed make a DOUBLE list.
+		// Throws if the item is not a list.
+		ValueType GetListType() const;
+
+		// The elements of a list of that type, parsed once when the list was
+		// set, as a contiguous array. The string elements stay available
+		// through GetList() and GetListView(). Throws if the item is not a
+		// list of that type.
+		ArrayView<int64_t> GetIntList() const;
+		ArrayView<double> GetDoubleList() const;
+		ArrayView<bool> GetBoolList() const;
+
+		// Exception-free accessors for hot paths. TryGetX returns an empty
+		// optional and GetXOr returns the fallback on a type mismatch.
+		// These are defined inline below so they reduce to a type check
+		// and a load at the call site.
+		std::optional<std::string_view> TryGetString() const noexcept;
+		std::optional<bool> TryGetBoolean() const noexcept;
+		std::optional<int64_t> TryGetInteger() const noexcept;
+		std::optional<double> TryGetDouble() const noexcept;
+		std::optional<ListView> TryGetList() const noexcept;
+		std::optional<int64_t> TryGetSize() const noexcept;
+		std::optional<std::chrono::nanoseconds> TryGetDuration() const noexcept;
+
+		std::string_view GetStringOr(std::string_view) const noexcept;
+		bool GetBooleanOr(bool) const noexcept;
+		int64_t GetIntegerOr(int64_t) const noexcept;
+		double GetDoubleOr(double) const noexcept;
+		int64_t GetSizeOr(int64_t) const noexcept;
+		std::chrono::nanoseconds GetDurationOr(std::chrono::nanoseconds) const noexcept;
 
 		void SetString(std::string);
 		void SetBoolean(bool);
 		void SetInteger(int64_t);
 		void SetDouble(double);
 		void SetList(std::vector<std::string>);
+		void SetList(ListView);
+		void SetSize(int64_t);
+		void SetDuration(std::chrono::nanoseconds);
+
+		// Whether this is a list with an element equal to the value, or one
+		// that reads as the integer. Lists of at least LIST_INDEX_MIN elements
+		// are indexed when set, with a hash table of their elements and a
+		// sorted array of those that are integers, so these are an O(1) and
+		// an O(log n) probe; shorter lists are scanned. Never copies.
+		bool Contains(std::string_view) const noexcept;
+		bool Contains(int64_t) const noexcept;
+
+		// Whether this is a list with an element that is the path, or a
+		// directory above it: "/srv/data" and "/srv/data/" cover
+		// "/srv/data/x", but not "/srv/database". Indexed lists are probed
+		// once per directory of the path.
+		bool ContainsPath(std::string_view) const noexcept;
+
+		// Lists shorter than this are scanned rather than indexed.
+		static constexpr size_t LIST_INDEX_MIN = 16;
+
+		// A 64-bit hash of the type and value, kept up to date by the setters.
+		// Items with equal hashes hold equal values, barring a 2^-64 collision.
+		// Zero for an item that was never set.
+		uint64_t Hash() const;
 
 	private:
-		ValueType valueType;
+		// Typed keys read values directly, without a type check.
+		template <typename T>
+		friend struct ValueTraits;
+
+		// Scalars are zero-initialized so an unchecked read of the wrong
+		// type is well-defined.
+		ValueType valueType = ValueType::STRING;
 		std::string stringValue;
-		bool booleanValue;
-		int64_t	integerValue;
-		double doubleValue;
-		std::vector<std::string> listValue;
+		bool booleanValue = false;
+		// Also holds sizes and durations.
+		int64_t	integerValue = 0;
+		double doubleValue = 0;
+		// List elements are stored back to back so that they can be handed
+		// out as a ListView without copying.
+		std::string listArena;
+		std::vector<Span> listSpans;
+		uint64_t hash = 0;
+
+		// The index of a long list. It refers to elements by position, so
+		// copies of the item share it.
+		std::shared_ptr<const ListIndex> listIndex;
+
+		// The type of the list elements, and their values unless they are
+		// strings. Shared by copies, like the index.
+		ValueType listType = ValueType::STRING;
+		std::shared_ptr<const ListValues> listValues;
+
+		void AppendListElement(std::string_view);
+
+		// Classify and parse the elements after the list changed.
+		void TypeList();
+
+		// Build or drop the list index after the list changed.
+		void IndexList();
+
+		// Whether the list has an element equal to the value.
+		bool HasElement(std::string_view) const noexcept;
+
+		// Recompute the hash after the value changed.
+		void Rehash();
 };
 
+inline std::optional<std::string_view> Item::TryGetString() const noexcept {
+	if (valueType != ValueType::STRING) {
+		return std::nullopt;
+	}
+	return std::string_view(stringValue);
+}
+
+inline std::optional<bool> Item::TryGetBoolean() const noexcept {
+	if (valueType != ValueType::BOOLEAN) {
+		return std::nullopt;
+	}
+	return booleanValue;
+}
+
+inline std::optional<int64_t> Item::TryGetInteger() const noexcept {
+	if (valueType != ValueType::INTEGER) {
+		return std::nullopt;
+	}
+	return integerValue;
+}
+
+inline std::optional<double> Item::TryGetDouble() const noexcept {
+	if (valueType != ValueType::DOUBLE) {
+		return std::nullopt;
+	}
+	return doubleValue;
+}
+
+inline std::optional<ListView> Item::TryGetList() const noexcept {
+	if (valueType != ValueType::LIST) {
+		return std::nullopt;
+	}
+	return ListView(listArena.data(), listSpans.data(), listSpans.size());
+}
+
+inline std::optional<int64_t> Item::TryGetSize() const noexcept {
+	if (valueType != ValueType::SIZE) {
+		return std::nullopt;
+	}
+	return integerValue;
+}
+
+inline std::optional<std::chrono::nanoseconds> Item::TryGetDuration() const noexcept {
+	if (valueType != ValueType::DURATION) {
+		return std::nullopt;
+	}
+	return std::chrono::nanoseconds(integerValue);
+}
+
+inline std::string_view Item::GetStringOr(std::string_view fallback) const noexcept {
+	return valueType == ValueType::STRING ? std::string_view(stringValue) : fallback;
+}
+
+inline bool Item::GetBooleanOr(bool fallback) const noexcept {
+	return valueType == ValueType::BOOLEAN ? booleanValue : fallback;
+}
+
+inline int64_t Item::GetIntegerOr(int64_t fallback) const noexcept {
+	return valueType == ValueType::INTEGER ? integerValue : fallback;
+}
+
+inline double Item::GetDoubleOr(double fallback) const noexcept {
+	return valueType == ValueType::DOUBLE ? doubleValue : fallback;
+}
+
+inline int64_t Item::GetSizeOr(int64_t fallback) const noexcept {
+	return valueType == ValueType::SIZE ? integerValue : fallback;
+}
+
+inline std::chrono::nanoseconds Item::GetDurationOr(std::chrono::nanoseconds fallback) const noexcept {
+	return valueType == ValueType::DURATION ? std::chrono::nanoseconds(integerValue) : fallback;
+}
+
 } // namespace Config
 
 #endif // CONFIG_ITEM_H_
@@ -1,5 +1,8 @@
+#include <chrono>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "../common/lest.hpp"
 #include "item.h"
@@ -87,6 +90,203 @@ const lest::test specification[] = {
 		EXPECT_THROWS_AS(item.GetBoolean(), std::runtime_error);
 		EXPECT_THROWS_AS(item.GetInteger(), std::runtime_error);
 		EXPECT_THROWS_AS(item.GetDouble(), std::runtime_error);
+	},
+
+	CASE("String and list views reference the item without copying") {
+		config::Item item;
+		item.SetString("foobar");
+		EXPECT(item.GetStringView() == "foobar");
+		EXPECT(item.GetStringView().data() == item.GetStringView().data());
+		EXPECT_THROWS_AS(item.GetListView(), std::runtime_error);
+
+		item.SetList({"foo", "", "baz"});
+		config::ListView list = item.GetListView();
+		EXPECT(list.size() == 3u);
+		EXPECT(list[0] == "foo");
+		EXPECT(list[1] == "");
+		EXPECT(list[2] == "baz");
+		EXPECT_THROWS_AS(item.GetStringView(), std::runtime_error);
+
+		// A copied item owns its own storage
+		config::Item copy = item;
+		item.SetList({"other"});
+		EXPECT(copy.GetListView()[2] == "baz");
+
+		// Setting a list from a view of itself keeps the elements
+		copy.SetList(copy.GetListView());
+		EXPECT(copy.GetList() == std::vector<std::string>({"foo", "", "baz"}));
+		config::Item longer;
+		longer.SetList({"a long element that does not fit inline", "", "1"});
+		longer.SetList(longer.GetListView());
+		EXPECT(longer.GetList() == std::vector<std::string>({"a long element that does not fit inline", "", "1"}));
+	},
+
+	CASE("Exception-free accessors return empty or fallback values on mismatch") {
+		config::Item item;
+		item.SetInteger(42);
+
+		EXPECT(item.TryGetInteger().value() == 42);
+		EXPECT(item.GetIntegerOr(7) == 42);
+		EXPECT(!item.TryGetString().has_value());
+		EXPECT(!item.TryGetBoolean().has_value());
+		EXPECT(!item.TryGetDouble().has_value());
+		EXPECT(!item.TryGetList().has_value());
+		EXPECT(item.GetStringOr("none") == "none");
+		EXPECT(item.GetBooleanOr(true) == true);
+		EXPECT(item.GetDoubleOr(1.5) == 1.5);
+
+		item.SetString("foobar");
+		EXPECT(item.TryGetString().value() == "foobar");
+		EXPECT(item.GetIntegerOr(7) == 7);
+
+		item.SetList({"foo", "bar"});
+		EXPECT(item.TryGetList()->size() == 2u);
+	},
+
+	CASE("Items hash their type and value") {
+		config::Item a;
+		config::Item b;
+		a.SetInteger(1);
+		b.SetInteger(1);
+		EXPECT(a.Hash() == b.Hash());
+
+		b.SetInteger(2);
+		EXPECT(a.Hash() != b.Hash());
+
+		// Same bytes, different types
+		b.SetBoolean(true);
+		EXPECT(a.Hash() != b.Hash());
+		a.SetString("1");
+		b.SetList({"1"});
+		EXPECT(a.Hash() != b.Hash());
+
+		// List elements are delimited
+		a.SetList({"ab", "c"});
+		b.SetList({"a", "bc"});
+		EXPECT(a.Hash() != b.Hash());
+
+		// Copies keep the hash
+		config::Item c = a;
+		EXPECT(c.Hash() == a.Hash());
+	},
+
+	CASE("List membership is the same whether or not the list is indexed") {
+		for (size_t length : {size_t(3), config::Item::LIST_INDEX_MIN, size_t(1000)}) {
+			std::vector<std::string> elements = {"/srv/data", "/var/log/", "-7", "x"};
+			for (size_t i = elements.size(); i < length; i++) {
+				elements.push_back(std::to_string(i * 3));
+			}
+			config::Item item;
+			item.SetList(elements);
+
+			EXPECT(item.Contains("x"));
+			EXPECT(item.Contains("/srv/data"));
+			EXPECT(!item.Contains("y"));
+			EXPECT(!item.Contains(""));
+			EXPECT(item.Contains(int64_t(-7)));
+			EXPECT(!item.Contains(int64_t(7)));
+			EXPECT(item.Contains(std::to_string((length - 1) * 3)) == (length > 4));
+			EXPECT(item.Contains(int64_t((length - 1) * 3)) == (length > 4));
+			EXPECT(!item.Contains(int64_t(length * 3)));
+
+			// Paths are covered by themselves and the directories above them
+			EXPECT(item.ContainsPath("/srv/data"));
+			EXPECT(item.ContainsPath("/srv/data/"));
+			EXPECT(item.ContainsPath("/srv/data/a/b"));
+			EXPECT(!item.ContainsPath("/srv/database"));
+			EXPECT(!item.ContainsPath("/srv"));
+			EXPECT(item.ContainsPath("/var/log/syslog"));
+			EXPECT(!item.ContainsPath("/var/log"));
+			EXPECT(!item.ContainsPath(""));
+
+			// Copies share the index, and setting a new list replaces it
+			config::Item copy = item;
+			EXPECT(copy.Contains("x"));
+			copy.SetList({"y"});
+			EXPECT(copy.Contains("y"));
+			EXPECT(!copy.Contains("x"));
+			EXPECT(item.Contains("x"));
+		}
+
+		config::Item scalar;
+		scalar.SetString("x");
+		EXPECT(!scalar.Contains("x"));
+		scalar.SetInteger(1);
+		EXPECT(!scalar.Contains(int64_t(1)));
+	},
+
+	CASE("Size and duration items are restricted to their type") {
+		config::Item item;
+		item.SetSize(26214400);
+		EXPECT(item.GetValueType() == config::ValueType::SIZE);
+		EXPECT(item.GetSize() == 26214400);
+		EXPECT(item.GetSizeOr(0) == 26214400);
+		EXPECT_THROWS_AS(item.GetInteger(), std::runtime_error);
+		EXPECT_THROWS_AS(item.GetDuration(), std::runtime_error);
+		EXPECT(item.GetIntegerOr(-1) == -1);
+
+		// Same amount, different types
+		config::Item integer;
+		integer.SetInteger(26214400);
+		EXPECT(integer.Hash() != item.Hash());
+		EXPECT(!integer.TryGetSize());
+
+		item.SetDuration(std::chrono::milliseconds(500));
+		EXPECT(item.GetValueType() == config::ValueType::DURATION);
+		EXPECT(item.GetDuration() == std::chrono::nanoseconds(500000000));
+		EXPECT(*item.TryGetDuration() == std::chrono::milliseconds(500));
+		EXPECT_THROWS_AS(item.GetSize(), std::runtime_error);
+		EXPECT(item.GetSizeOr(-1) == -1);
+	},
+
+	CASE("Lists of one element type are parsed once into typed arrays") {
+		config::Item item;
+		item.SetList({"1", "-20", "300"});
+		EXPECT(item.GetListType() == config::ValueType::INTEGER);
+		config::ArrayView<int64_t> integers = item.GetIntList();
+		EXPECT(integers.size() == 3u);
+		EXPECT(integers[0] == 1);
+		EXPECT(integers[1] == -20);
+		EXPECT(integers[2] == 300);
+		int64_t sum = 0;
+		for (int64_t value : integers) {
+			sum += value;
+		}
+		EXPECT(sum == 281);
+		EXPECT(item.GetList()[1] == "-20");
+		EXPECT_THROWS_AS(item.GetDoubleList(), std::runtime_error);
+
+		// Integers and doubles mixed are doubles
+		item.SetList({"1", "2.5", ".5"});
+		EXPECT(item.GetListType() == config::ValueType::DOUBLE);
+		EXPECT(item.GetDoubleList()[0] == 1.0);
+		EXPECT(item.GetDoubleList()[1] == 2.5);
+		EXPECT(item.GetDoubleList()[2] == 0.5);
+		EXPECT_THROWS_AS(item.GetIntList(), std::runtime_error);
+
+		item.SetList({"yes", "false", "true", "no"});
+		EXPECT(item.GetListType() == config::ValueType::BOOLEAN);
+		config::ArrayView<bool> booleans = item.GetBoolList();
+		EXPECT(booleans.size() == 4u);
+		EXPECT((booleans[0] && !booleans[1] && booleans[2] && !booleans[3]));
+
+		// Anything else, including numbers out of range, is a list of strings
+		for (std::vector<std::string> strings : std::vector<std::vector<std::string>>{{"1", "a"}, {"yes", "1"},
+				{"1", "99999999999999999999"}, {"1.2.3", "4"}, {"-", "1"}, {"1e5", "2"}}) {
+			item.SetList(strings);
+			EXPECT(item.GetListType() == config::ValueType::STRING);
+			EXPECT_THROWS_AS(item.GetIntList(), std::runtime_error);
+			EXPECT_THROWS_AS(item.GetBoolList(), std::runtime_error);
+		}
+
+		// Copies keep the parsed values
+		item.SetList({"7", "8"});
+		config::Item copy = item;
+		EXPECT(copy.GetIntList()[1] == 8);
+
+		item.SetInteger(7);
+		EXPECT_THROWS_AS(item.GetListType(), std::runtime_error);
+		EXPECT_THROWS_AS(item.GetIntList(), std::runtime_error);
 	}
 };
 
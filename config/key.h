@@ -0,0 +1,108 @@
+/*
+ * A Key object is a compile-time "section.key" name paired with the C++ type
+ * of its value. The hash of the name is computed by the compiler, so looking
+ * up a Key does not hash at runtime.
+ */
+
+#ifndef CONFIG_KEY_H_
+#define CONFIG_KEY_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+#include "item.h"
+
+namespace config {
+
+// 64-bit FNV-1a hash. Usable in constant expressions.
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+constexpr uint64_t HashKey(std::string_view in, uint64_t seed = FNV_OFFSET_BASIS) {
+	uint64_t hash = seed;
+	for (const auto& c : in) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// A 64-bit finalizer (from MurmurHash3) that spreads every input bit over
+// the whole output. FNV-1a alone mixes poorly into its top and bottom bits,
+// so apply this before taking a subset of the bits as a table index.
+constexpr uint64_t MixHash(uint64_t hash) {
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+// Maps a C++ type to the ValueType it is stored as. Only the specializations
+// below exist, so a Key of any other type fails to compile.
+template <typename T>
+struct ValueTraits;
+
+template <>
+struct ValueTraits<std::string_view> {
+	static constexpr ValueType type = ValueType::STRING;
+	static std::string_view Read(const Item& item) noexcept { return item.stringValue; }
+};
+
+template <>
+struct ValueTraits<bool> {
+	static constexpr ValueType type = ValueType::BOOLEAN;
+	static bool Read(const Item& item) noexcept { return item.booleanValue; }
+};
+
+template <>
+struct ValueTraits<int64_t> {
+	static constexpr ValueType type = ValueType::INTEGER;
+	static int64_t Read(const Item& item) noexcept { return item.integerValue; }
+};
+
+template <>
+struct ValueTraits<double> {
+	static constexpr ValueType type = ValueType::DOUBLE;
+	static double Read(const Item& item) noexcept { return item.doubleValue; }
+};
+
+template <>
+struct ValueTraits<std::chrono::nanoseconds> {
+	static constexpr ValueType type = ValueType::DURATION;
+	static std::chrono::nanoseconds Read(const Item& item) noexcept { return std::chrono::nanoseconds(item.integerValue); }
+};
+
+template <>
+struct ValueTraits<ListView> {
+	static constexpr ValueType type = ValueType::LIST;
+	static ListView Read(const Item& item) noexcept {
+		return ListView(item.listArena.data(), item.listSpans.data(), item.listSpans.size());
+	}
+};
+
+// Whether a key of one type reads an item of another. Sizes are whole
+// numbers of bytes, stored like integers, so integer keys read them too,
+// and an integer setting can be given a unit without breaking its readers.
+constexpr bool KeyReads(ValueType key, ValueType item) {
+	return key == item || (key == ValueType::INTEGER && item == ValueType::SIZE);
+}
+
+// A typed key. Declare keys as constexpr so the hash is folded at compile time:
+//   constexpr config::Key<int64_t> kPaidLimit("common.paid_users_size_limit");
+template <typename T>
+class Key {
+	public:
+		constexpr explicit Key(std::string_view name) : name(name), hash(HashKey(name)) {}
+
+		static constexpr ValueType type = ValueTraits<T>::type;
+
+		const std::string_view name;
+		const uint64_t hash;
+};
+
+} // namespace config
+
+#endif // CONFIG_KEY_H_
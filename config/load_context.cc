@@ -0,0 +1,30 @@
+#include "load_context.h"
+
+namespace config {
+
+LoadContext::LoadContext() : LoadContext(std::pmr::get_default_resource()) {}
+
+LoadContext::LoadContext(std::pmr::memory_resource* upstream)
+	: pool(upstream),
+	  parser(&pool),
+	  buffer(&pool),
+	  line(&pool),
+	  overridesSet(&pool),
+	  overridenKeys(&pool),
+	  blocks(&pool) {}
+
+void LoadContext::Clear() {
+	// clear() keeps string capacity and hash table bucket arrays, and the
+	// nodes that it frees return to the pool for the next load.
+	buffer.clear();
+	ClearScratch();
+}
+
+void LoadContext::ClearScratch() {
+	line.clear();
+	overridesSet.clear();
+	overridenKeys.clear();
+	blocks.clear();
+}
+
+} // namespace config
@@ -0,0 +1,75 @@
+/*
+ * A LoadContext object holds the scratch state of Handler::Load (file and
+ * line buffers, temporary hash tables, parser scratch memory) so that it can
+ * be reused across loads instead of being rebuilt from scratch each time.
+ */
+
+#ifndef CONFIG_LOAD_CONTEXT_H_
+#define CONFIG_LOAD_CONTEXT_H_
+
+#include <cstdint>
+#include <memory_resource>
+#include <unordered_set>
+#include <vector>
+
+#include "parser.h"
+
+namespace config {
+
+class Handler;
+
+// A run of lines belonging to one section: a section line and the settings
+// that follow it, up to the next section line. Settings before the first
+// section line form a block of the unnamed section.
+struct SectionBlock {
+	uint32_t sectionId;
+	size_t begin;
+	size_t end;
+};
+
+class LoadContext {
+  private:
+	friend class Handler;
+
+	// Freed scratch blocks go back to this pool rather than the upstream
+	// resource, so steady-state reloads of a similar-sized config reuse
+	// memory from the previous load. Declared first so it outlives the
+	// containers below.
+	std::pmr::unsynchronized_pool_resource pool;
+
+	// Allocates its scratch (e.g. list tokens) from the pool.
+	Parser parser;
+
+	// The whole file, and the current stripped line.
+	std::pmr::string buffer;
+	std::pmr::string line;
+
+	// Interned override tags requested for this load, and the packed
+	// (section ID, key ID) pairs that an override has already set.
+	std::pmr::unordered_set<uint32_t> overridesSet;
+	std::pmr::unordered_set<uint64_t> overridenKeys;
+
+	// The section blocks of the file, in file order.
+	std::pmr::vector<SectionBlock> blocks;
+
+	// Empty every container while keeping its capacity.
+	void Clear();
+
+	// Same as above, but keeps the file in the buffer, to apply it again.
+	void ClearScratch();
+
+  public:
+	// Allocate from the default memory resource.
+	LoadContext();
+
+	// Allocate from the given resource. It must outlive the context.
+	explicit LoadContext(std::pmr::memory_resource*);
+
+	// Contexts own pointers into themselves, so they cannot be copied.
+	LoadContext(const LoadContext&) = delete;
+	LoadContext& operator=(const LoadContext&) = delete;
+};
+
+} // namespace config
+
+#endif // CONFIG_LOAD_CONTEXT_H_
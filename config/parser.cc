@@ -1,3 +1,5 @@
+#include <charconv>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -5,6 +7,7 @@
 #include <stdexcept>
 
 #include "parser.h"
+#include "units.h"
 
 namespace config {
 
@@ -13,6 +16,10 @@ using std::string;
 using std::unordered_map;
 using std::vector;
 
+Parser::Parser() : resource(std::pmr::get_default_resource()) {}
+
+Parser::Parser(std::pmr::memory_resource* resource) : resource(resource) {}
+
 vector<string> Parser::ParseFile(string filename) {
 	// Try to open file
 	std::ifstream file(filename);
@@ -29,6 +36,22 @@ vector<string> Parser::ParseFile(string filename) {
 	return lines;
 }
 
+void Parser::ReadFile(const string& filename, std::pmr::string& buffer) {
+	// Try to open file
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error(errors::FILE_OPEN);
+	}
+
+	// Size the buffer once, then read everything in one go.
+	file.seekg(0, std::ios::end);
+	std::streamoff size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	buffer.resize(size > 0 ? static_cast<size_t>(size) : 0);
+	file.read(&buffer[0], buffer.size());
+	buffer.resize(static_cast<size_t>(file.gcount()));
+}
+
 void Parser::ReplaceChar(string& str, const string& from, const string& to) {
 	size_t start_pos = str.find(from);
 	if(start_pos == string::npos) {
@@ -38,14 +61,28 @@ void Parser::ReplaceChar(string& str, const string& from, const string& to) {
 }
 
 string Parser::StripLine(string in) {
-	string out = "";
+	std::pmr::string out(resource);
+	StripLine(in, out);
+	return string(out);
+}
+
+void Parser::StripLine(std::string_view in, std::pmr::string& out) {
+	out.clear();
 	bool inQuotes = false;
 
-	// Replace weird quotes with standard UTF-8 versions
-	this->ReplaceChar(in, "\u201C","\u0022"); // replaces “
-	this->ReplaceChar(in, "\u201D","\u0022"); // replaces ”
+	// Replace weird quotes with standard UTF-8 versions. As with ReplaceChar,
+	// only the first of each kind is replaced.
+	const std::string_view leftQuote = "\u201C"; // “
+	const std::string_view rightQuote = "\u201D"; // ”
+	string::size_type leftPos = in.find(leftQuote);
+	string::size_type rightPos = in.find(rightQuote);
 
-	for (const auto& c : in) {
+	for (string::size_type i = 0; i < in.length(); i++) {
+	char c = in[i];
+	if (i == leftPos || i == rightPos) {
+		c = constants::QUOTE;
+		i += leftQuote.length() - 1;
+	}
 	// If we encounter comment delimiter, skip rest of line
 	// (but only if we're not inside quotes)
 	if (c == constants::COMMENT_DELIM && !inQuotes) {
@@ -67,11 +104,9 @@ string Parser::StripLine(string in) {
 	// Add character to out string
 	out += c;
 	}
-
-	return out;
 }
 
-bool Parser::IsValidSection(string in) {
+bool Parser::IsValidSection(std::string_view in) {
 	// Note: all whitespaces have been stripped
 	// A valid section must be at least 3 characters long
 	// Example: "[a]"
@@ -105,15 +140,22 @@ string Parser::ParseSection(string in) {
 }
 
 SingleSetting Parser::ParseSetting(string in, string section) {
+	SettingView view = ParseSettingView(in, section);
+
+	SingleSetting setting;
+	setting.section = string(view.section);
+	setting.key = string(view.key);
+	setting.override = string(view.override);
+	setting.value = string(view.value);
+	return setting;
+}
+
+SettingView Parser::ParseSettingView(std::string_view in, std::string_view section) {
 	// Note: all whitespaces have been stripped
 	// Lines are expected to be settings, not sections
 
 	// Prepare default, empty setting
-	SingleSetting setting;
-	setting.section = "";
-	setting.key = "";
-	setting.override = "";
-	setting.value = "";
+	SettingView setting;
 
 	// A valid setting line must be at least 3 characters long
 	// Example: "a=b"
@@ -130,7 +172,7 @@ SingleSetting Parser::ParseSetting(string in, string section) {
 	}
 
 	// Grab everything on the left of quals
-	string left = in.substr(0, pos);
+	std::string_view left = in.substr(0, pos);
 
 	// Search for override
 	string::size_type oStart = left.find(constants::OVERRIDE_START);
@@ -147,7 +189,7 @@ SingleSetting Parser::ParseSetting(string in, string section) {
 		// - exactly one >, at position length()-1 of left
 		return setting;
 	}
-	string override = "";
+	std::string_view override;
 	if (foundStart) {
 		for (unsigned int i = oStart+1; i < oEnd; i++) {
 			const char& c = left[i];
@@ -155,10 +197,9 @@ SingleSetting Parser::ParseSetting(string in, string section) {
 				// Only allow any combination of alphanum, hyphen, and underscore
 				std::cout << left[i+1] << "\t";
 				return setting;
-			} else {
-				override += c;
 			}
 		}
+		override = left.substr(oStart+1, oEnd-oStart-1);
 	}
 
 	// We liberally allow all remaining string permutations for the key & value.
@@ -168,7 +209,7 @@ SingleSetting Parser::ParseSetting(string in, string section) {
 	// helper functions that validate the key and value values below.
 
 	// Populate key
-	string key = "";
+	std::string_view key;
 	if (foundStart) {
 		key = in.substr(0, oStart);
 	} else {
@@ -176,7 +217,7 @@ SingleSetting Parser::ParseSetting(string in, string section) {
 	}
 
 	// Grab everything on the right of equals as value
-	string value = in.substr(pos + 1);
+	std::string_view value = in.substr(pos + 1);
 
 	// If we reached here, line is a valid setting
 	setting.section = section;
@@ -186,14 +227,14 @@ SingleSetting Parser::ParseSetting(string in, string section) {
 	return setting;
 }
 
-config::Item Parser::ConstructValueObject(string in) {
+config::Item Parser::ConstructValueObject(std::string_view in) {
 	// Note: all whitespaces have been stripped except inside quotes.
 	config::Item configItem;
 
 	// An empty string should never be sent to this function, but
 	// early return to avoid accessing an index that doesn't exist later.
 	if (in.length() == 0) {
-		configItem.SetString(in);
+		configItem.SetString(string(in));
 		return configItem;
 	}
 
@@ -202,7 +243,7 @@ config::Item Parser::ConstructValueObject(string in) {
 	// include the quotes -- the quotes are there to demonstrate intent that
 	// the type within is a string.
 	if (in[0] == constants::QUOTE) {
-		string strippedString = in.substr(1, in.length()-2);
+		string strippedString(in.substr(1, in.length()-2));
 		configItem.SetString(strippedString);
 		return configItem;
 	}
@@ -235,65 +276,169 @@ config::Item Parser::ConstructValueObject(string in) {
 		}
 	}
 
-	// Try to convert to number
+	// Try to convert to number. std::from_chars works on the view directly
+	// and, like std::stod/std::stoll, rejects out of range values and lone
+	// signs or decimal points.
 	if (isNum) {
+		const char* end = in.data() + in.length();
 		if (foundDecimal) {
-			try {
-				double doubleValue = std::stod(in);
-				configItem.SetDouble(doubleValue);
-				return configItem;
-			} catch (std::exception e) {
+			double doubleValue = 0;
+			std::from_chars_result result = std::from_chars(in.data(), end, doubleValue);
+			if (result.ec != std::errc() || result.ptr != end) {
 				throw std::runtime_error(errors::SETTING_MAX_DOUBLE);
 			}
+			configItem.SetDouble(doubleValue);
+			return configItem;
 		} else {
-			try {
-				int64_t intValue = std::stoll(in);
-				configItem.SetInteger(intValue);
-				return configItem;
-			} catch (std::exception e) {
+			int64_t intValue = 0;
+			std::from_chars_result result = std::from_chars(in.data(), end, intValue);
+			if (result.ec != std::errc() || result.ptr != end) {
 				throw std::runtime_error(errors::SETTING_MAX_INTEGER);
 			}
+			configItem.SetInteger(intValue);
+			return configItem;
 		}
 	}
 
 	// If we reached here, we have ruled out number.
+	// Next up are sizes and durations: digits and a unit suffix, such as
+	// 25MiB or 500ms. Other values that start with a digit fall through.
+	if (isdigit(in[0])) {
+		ValueType unitType = ValueType::INTEGER;
+		int64_t amount = 0;
+		switch (ReadUnitValue(in, unitType, amount)) {
+			case UnitRead::VALUE:
+				if (unitType == ValueType::SIZE) {
+					configItem.SetSize(amount);
+				} else {
+					configItem.SetDuration(std::chrono::nanoseconds(amount));
+				}
+				return configItem;
+			case UnitRead::TOO_LARGE:
+				throw std::runtime_error(errors::SETTING_MAX_UNIT);
+			case UnitRead::NONE:
+				break;
+		}
+	}
+
 	// Next up is Bool. As a design decision, in order for the config item
 	// to write itself as a boolean primitive, we will support the following
 	// strings as read from the raw config file. In order to avoid ambiguity,
 	// "1" and "0" without quotes will always be considered numbers, and always
 	// considered strings with quotes.
-	unordered_map<string, bool> permittedBoolValues = {
-		{"yes", true},
-		{"no", false},
-		{"true", true},
-		{"false", false}
-	};
-	if (permittedBoolValues.count(in) > 0) {
-		// Found a match for bool
-		configItem.SetBoolean(permittedBoolValues[in]);
+	if (in == "yes" || in == "true") {
+		configItem.SetBoolean(true);
+		return configItem;
+	}
+	if (in == "no" || in == "false") {
+		configItem.SetBoolean(false);
 		return configItem;
 	}
 
 	// The only remaining supported types are string and list of strings.
 	// Check if the input string is a list of comma-separated values.
 	// As a design decision, we do not permit empty strings in the list.
-	// Ref: http://stackoverflow.com/questions/11719538/how-to-use-stringstream-to-separate-comma-separated-strings
-	string token;
-	vector<string> list;
-	std::istringstream ss(in);
-	while(std::getline(ss, token, constants::COMMA)) {
-		if (token != "") {
-			list.push_back(token);
+	// Elements are recorded as spans into the input, using scratch memory
+	// from the parser's resource, and copied into the item once.
+	std::pmr::vector<Span> list(resource);
+	string::size_type start = 0;
+	for (string::size_type i = 0; i <= in.length(); i++) {
+		if (i == in.length() || in[i] == constants::COMMA) {
+			if (i > start) {
+				Span span;
+				span.offset = static_cast<uint32_t>(start);
+				span.length = static_cast<uint32_t>(i - start);
+				list.push_back(span);
+			}
+			start = i + 1;
 		}
 	}
 	if (list.size() > 1) {
-		configItem.SetList(list);
+		configItem.SetList(ListView(in.data(), list.data(), list.size()));
 		return configItem;
 	}
 
 	// If we reached here, the only remaining supported type is string.
-	configItem.SetString(in);
+	configItem.SetString(string(in));
 	return configItem;
 }
 
+string Parser::FormatValue(const Item& item) {
+	// Characters that the parser would strip, split on or treat as quotes.
+	// Curly quotes are normalized to straight ones, so they cannot appear
+	// in a value either.
+	auto writable = [](std::string_view text, std::string_view special) {
+		return text.find_first_of(special) == std::string_view::npos
+			&& text.find("\u201C") == std::string_view::npos
+			&& text.find("\u201D") == std::string_view::npos;
+	};
+
+	char digits[512];
+	std::to_chars_result result;
+	switch (item.GetValueType()) {
+		case ValueType::STRING: {
+			std::string_view text = item.GetStringView();
+			if (!writable(text, "\"\r\n")) {
+				throw std::runtime_error(errors::SETTING_UNWRITABLE);
+			}
+			string out;
+			out.reserve(text.length() + 2);
+			out += constants::QUOTE;
+			out += text;
+			out += constants::QUOTE;
+			return out;
+		}
+		case ValueType::BOOLEAN:
+			return item.GetBoolean() ? "true" : "false";
+		case ValueType::INTEGER:
+			result = std::to_chars(digits, digits + sizeof(digits), item.GetInteger());
+			return string(digits, result.ptr);
+		case ValueType::DOUBLE: {
+			// Fixed notation, since exponents do not parse as numbers, and a
+			// decimal point, since numbers without one parse as integers.
+			double value = item.GetDouble();
+			if (!std::isfinite(value)) {
+				throw std::runtime_error(errors::SETTING_UNWRITABLE);
+			}
+			result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed);
+			string out(digits, result.ptr);
+			if (out.find(constants::DECIMAL) == string::npos) {
+				out += ".0";
+			}
+			return out;
+		}
+		case ValueType::SIZE:
+		case ValueType::DURATION: {
+			// In the largest unit the amount is a whole number of. Units
+			// carry no sign, so negative amounts cannot be written.
+			int64_t amount = item.GetValueType() == ValueType::SIZE ? item.GetSize() : item.GetDuration().count();
+			if (amount < 0) {
+				throw std::runtime_error(errors::SETTING_UNWRITABLE);
+			}
+			const Unit& unit = LargestUnit(item.GetValueType(), amount);
+			result = std::to_chars(digits, digits + sizeof(digits), amount / unit.scale);
+			return string(digits, result.ptr) + string(unit.suffix);
+		}
+		case ValueType::LIST: {
+			// Lists of fewer than two elements would parse as strings.
+			ListView list = item.GetListView();
+			if (list.size() < 2) {
+				throw std::runtime_error(errors::SETTING_UNWRITABLE);
+			}
+			string out;
+			for (std::string_view element : list) {
+				if (element.empty() || !writable(element, " ,;\"\r\n")) {
+					throw std::runtime_error(errors::SETTING_UNWRITABLE);
+				}
+				if (!out.empty()) {
+					out += constants::COMMA;
+				}
+				out += element;
+			}
+			return out;
+		}
+	}
+	return "";
+}
+
 } // namespace config
@@ -5,7 +5,9 @@
 #ifndef CONFIG_PARSER_H_
 #define CONFIG_PARSER_H_
 
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -27,12 +29,34 @@ struct SingleSetting {
 		string value;
 };
 
+// Same as SingleSetting, but referencing the stripped line it was parsed
+// from instead of owning copies. Only valid while that line is unchanged.
+struct SettingView {
+	public:
+		std::string_view section;
+		std::string_view key;
+		std::string_view override;
+		std::string_view value;
+};
+
 // Main parser class.
 class Parser {
+	private:
+		// Scratch allocations made while parsing (e.g. splitting lists) come
+		// from this resource.
+		std::pmr::memory_resource* resource;
+
 	public:
+		Parser();
+		explicit Parser(std::pmr::memory_resource*);
+
 		// Parse a file's contents into a vector of strings for each line.
 		vector<string> ParseFile(string);
 
+		// Read a whole file into a buffer in a single allocation, so that lines
+		// can be parsed as views into it.
+		void ReadFile(const string&, std::pmr::string&);
+
 		// Replace a bad character with a good one, expressed as UTF escaped strings.
 		// Ref: http://stackoverflow.com/questions/17389487/c-how-to-replace-unusual-quotes-in-code
 		void ReplaceChar(string&, const string&, const string&);
@@ -40,8 +64,12 @@ class Parser {
 		// Strip string of comments and spaces (except when in quotes).
 		string StripLine(string);
 
+		// Same as above, but writes into a caller-owned buffer so that the
+		// buffer's capacity can be reused from line to line.
+		void StripLine(std::string_view, std::pmr::string&);
+
 		// Check if a stipped line is a section header.
-		bool IsValidSection(string);
+		bool IsValidSection(std::string_view);
 
 		// Extract the section string from a valid section line.
 		string ParseSection(string);
@@ -53,11 +81,21 @@ class Parser {
 		// struct object contains all string members.
 		SingleSetting ParseSetting(string, string);
 
+		// Same as above, but returns views into the line and section instead
+		// of copies. An invalid setting has an empty key.
+		SettingView ParseSettingView(std::string_view, std::string_view);
+
 		// Parse a validated value into an Item object. This function is
 		// responsible for converting the value string into one of the supported
 		// heterogeneous types. A config item object is the type of object that is
 		// exposed to the caller/user of the config system.
-		Item ConstructValueObject(string);
+		Item ConstructValueObject(std::string_view);
+
+		// The inverse of ConstructValueObject: format an item as the value of
+		// a setting, such that parsing it back yields an equal item. Strings
+		// are always quoted. Throws if the item cannot be written that way,
+		// e.g. a string containing a quote or a list element containing a comma.
+		string FormatValue(const Item&);
 };
 
 namespace constants {
@@ -1,4 +1,6 @@
+#include <chrono>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 
 #include "../common/lest.hpp"
@@ -31,6 +33,33 @@ const lest::test specification[] = {
 		EXPECT(parser.StripLine("foobar=\"forever;alone\"; This is a comment") == "foobar=\"forever;alone\"");
 	},
 
+	CASE("StripLine into a reusable buffer matches StripLine") {
+		config::Parser parser;
+		std::pmr::string out;
+
+		parser.StripLine("name = “hello there, ftp uploading”; comment", out);
+		EXPECT(out == "name=\"hello there, ftp uploading\"");
+
+		// The buffer is overwritten, not appended to
+		parser.StripLine("path = /tmp/", out);
+		EXPECT(out == "path=/tmp/");
+	},
+
+	CASE("ParseSettingView returns views of the parsed line") {
+		config::Parser parser;
+		std::string line = "path<production>=/srv/var/tmp/";
+		config::SettingView setting = parser.ParseSettingView(line, "ftp");
+
+		EXPECT(setting.section == "ftp");
+		EXPECT(setting.key == "path");
+		EXPECT(setting.override == "production");
+		EXPECT(setting.value == "/srv/var/tmp/");
+		EXPECT(setting.value.data() == line.data() + 17);
+
+		// Invalid settings have an empty key
+		EXPECT(parser.ParseSettingView("path<production=/tmp/", "ftp").key == "");
+	},
+
 	CASE("IsValidSection correctly validates sections") {
 		config::Parser parser;
 
@@ -263,6 +292,42 @@ const lest::test specification[] = {
 		item = parser.ConstructValueObject(stringValue);
 		EXPECT(item.GetValueType() == config::ValueType::LIST);
 		EXPECT(item.GetList() == listValue);
+		EXPECT(item.GetListType() == config::ValueType::STRING);
+
+		// Lists of numbers are parsed into typed arrays as well
+		item = parser.ConstructValueObject("80,443,-1");
+		EXPECT(item.GetValueType() == config::ValueType::LIST);
+		EXPECT(item.GetListType() == config::ValueType::INTEGER);
+		EXPECT(item.GetIntList()[1] == 443);
+		EXPECT(item.GetList()[1] == "443");
+		item = parser.ConstructValueObject("0.5,2");
+		EXPECT(item.GetListType() == config::ValueType::DOUBLE);
+		EXPECT(item.GetDoubleList()[1] == 2.0);
+
+		// Sizes and durations are stored in bytes and nanoseconds
+		item = parser.ConstructValueObject("25MiB");
+		EXPECT(item.GetValueType() == config::ValueType::SIZE);
+		EXPECT(item.GetSize() == 26214400);
+		EXPECT(parser.ConstructValueObject("2KB").GetSize() == 2000);
+		EXPECT(parser.ConstructValueObject("0B").GetSize() == 0);
+		EXPECT(parser.ConstructValueObject("8EiB").GetValueType() == config::ValueType::STRING);
+		item = parser.ConstructValueObject("30s");
+		EXPECT(item.GetValueType() == config::ValueType::DURATION);
+		EXPECT(item.GetDuration() == std::chrono::seconds(30));
+		EXPECT(parser.ConstructValueObject("500ms").GetDuration() == std::chrono::milliseconds(500));
+		EXPECT(parser.ConstructValueObject("2h").GetDuration() == std::chrono::hours(2));
+
+		// Anything else that starts with a digit is not a unit value
+		for (std::string other : {"3rd", "1.5s", "10 s", "5sec", "1s,2s"}) {
+			EXPECT(parser.ConstructValueObject(other).GetValueType() != config::ValueType::DURATION);
+		}
+
+		// Amounts that do not fit in 64 bits are errors, like integers
+		EXPECT(parser.ConstructValueObject("8191PiB").GetSize() == int64_t(8191) << 50);
+		EXPECT_THROWS_AS(parser.ConstructValueObject("8192PiB"), std::runtime_error);
+		EXPECT(parser.ConstructValueObject("106751d").GetValueType() == config::ValueType::DURATION);
+		EXPECT_THROWS_AS(parser.ConstructValueObject("106752d"), std::runtime_error);
+		EXPECT_THROWS_AS(parser.ConstructValueObject("99999999999999999999ns"), std::runtime_error);
 
 		// Test strings
 		stringValue = "/srv/var/tmp/";
@@ -278,6 +343,65 @@ const lest::test specification[] = {
 		EXPECT(item.GetValueType() == config::ValueType::STRING);
 		EXPECT(item.GetString() == strippedStringValue);
 	},
+
+	CASE("FormatValue writes values that parse back to the same item") {
+		config::Parser parser;
+		config::Item item;
+
+		item.SetString("hello there, ftp uploading");
+		EXPECT(parser.FormatValue(item) == "\"hello there, ftp uploading\"");
+		EXPECT(parser.ConstructValueObject(parser.FormatValue(item)).GetString() == item.GetString());
+
+		// Strings are quoted, so they are never read back as another type
+		item.SetString("26214400");
+		EXPECT(parser.ConstructValueObject(parser.FormatValue(item)).GetValueType() == config::ValueType::STRING);
+
+		item.SetBoolean(false);
+		EXPECT(parser.FormatValue(item) == "false");
+
+		item.SetInteger(-2147483648);
+		EXPECT(parser.FormatValue(item) == "-2147483648");
+
+		// Doubles keep a decimal point, so they are not read back as integers
+		item.SetDouble(3.0);
+		EXPECT(parser.FormatValue(item) == "3.0");
+		item.SetDouble(-3.14);
+		EXPECT(parser.ConstructValueObject(parser.FormatValue(item)).GetDouble() == -3.14);
+
+		item.SetList({"array", "of", "values"});
+		EXPECT(parser.FormatValue(item) == "array,of,values");
+		EXPECT(parser.ConstructValueObject(parser.FormatValue(item)).GetList() == item.GetList());
+
+		// Sizes and durations are written in the largest unit that fits exactly
+		item.SetSize(26214400);
+		EXPECT(parser.FormatValue(item) == "25MiB");
+		item.SetSize(3000);
+		EXPECT(parser.FormatValue(item) == "3KB");
+		item.SetSize(1001);
+		EXPECT(parser.FormatValue(item) == "1001B");
+		item.SetDuration(std::chrono::seconds(90));
+		EXPECT(parser.FormatValue(item) == "90s");
+		item.SetDuration(std::chrono::hours(48));
+		EXPECT(parser.FormatValue(item) == "2d");
+		item.SetDuration(std::chrono::nanoseconds(0));
+		EXPECT(parser.FormatValue(item) == "0ns");
+		for (int64_t amount : {int64_t(1), int64_t(1536), int64_t(1) << 40, std::numeric_limits<int64_t>::max()}) {
+			item.SetSize(amount);
+			EXPECT(parser.ConstructValueObject(parser.FormatValue(item)).GetSize() == amount);
+			item.SetDuration(std::chrono::nanoseconds(amount));
+			EXPECT(parser.ConstructValueObject(parser.FormatValue(item)).GetDuration() == item.GetDuration());
+		}
+
+		// Values that cannot be read back throw
+		item.SetString("say \"hi\"");
+		EXPECT_THROWS_AS(parser.FormatValue(item), std::runtime_error);
+		item.SetList({"a,b", "c"});
+		EXPECT_THROWS_AS(parser.FormatValue(item), std::runtime_error);
+		item.SetList({"single"});
+		EXPECT_THROWS_AS(parser.FormatValue(item), std::runtime_error);
+		item.SetDuration(std::chrono::seconds(-1));
+		EXPECT_THROWS_AS(parser.FormatValue(item), std::runtime_error);
+	},
 };
 
 int main(int argc, char* argv[]) {
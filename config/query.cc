@@ -0,0 +1,211 @@
+#include <charconv>
+#include <cmath>
+
+#include "query.h"
+
+namespace config {
+
+// For readability
+using std::string;
+
+namespace {
+
+// The name of each ValueType, as written in TSV output.
+const char* TypeName(ValueType type) {
+	switch (type) {
+		case ValueType::STRING:
+			return "string";
+		case ValueType::BOOLEAN:
+			return "boolean";
+		case ValueType::INTEGER:
+			return "integer";
+		case ValueType::DOUBLE:
+			return "double";
+		case ValueType::LIST:
+			return "list";
+		case ValueType::SIZE:
+			return "size";
+		case ValueType::DURATION:
+			return "duration";
+	}
+	return "none";
+}
+
+} // namespace
+
+QueryWriter::QueryWriter(FILE* file, QueryFormat format)
+	: file(file), format(format), count(0), missing(0), finished(false) {
+	buffer.reserve(BUFFER_SIZE + 4096);
+}
+
+QueryWriter::~QueryWriter() {
+	Finish();
+}
+
+void QueryWriter::Write(std::string_view key, const ItemView& value) {
+	if (!value.IsValid()) {
+		missing++;
+	}
+	switch (format) {
+		case QueryFormat::TEXT:
+			AppendValue(value);
+			buffer += '\n';
+			break;
+		case QueryFormat::TSV:
+			AppendEscaped(key);
+			buffer += '\t';
+			buffer += value.IsValid() ? TypeName(value.GetValueType()) : "none";
+			buffer += '\t';
+			AppendValue(value);
+			buffer += '\n';
+			break;
+		case QueryFormat::JSON:
+			buffer += count == 0 ? "{\n  " : ",\n  ";
+			AppendEscaped(key);
+			buffer += ": ";
+			AppendValue(value);
+			break;
+	}
+	count++;
+	if (buffer.size() >= BUFFER_SIZE) {
+		Flush();
+	}
+}
+
+bool QueryWriter::Finish() {
+	if (!finished) {
+		finished = true;
+		if (format == QueryFormat::JSON) {
+			buffer += count == 0 ? "{}\n" : "\n}\n";
+		}
+		Flush();
+		fflush(file);
+	}
+	return !ferror(file);
+}
+
+size_t QueryWriter::Missing() const {
+	return missing;
+}
+
+void QueryWriter::Flush() {
+	fwrite(buffer.data(), 1, buffer.size(), file);
+	buffer.clear();
+}
+
+void QueryWriter::AppendValue(const ItemView& value) {
+	bool json = format == QueryFormat::JSON;
+	if (!value.IsValid()) {
+		if (json) {
+			buffer += "null";
+		}
+		return;
+	}
+	switch (value.GetValueType()) {
+		case ValueType::STRING:
+			AppendEscaped(value.GetStringView());
+			break;
+		case ValueType::BOOLEAN:
+			buffer += value.GetBoolean() ? "true" : "false";
+			break;
+		case ValueType::INTEGER:
+			AppendInteger(value.GetInteger());
+			break;
+		case ValueType::DOUBLE:
+			AppendDouble(value.GetDouble());
+			break;
+		case ValueType::SIZE:
+			AppendInteger(value.GetSize());
+			break;
+		case ValueType::DURATION:
+			AppendInteger(value.GetDuration().count());
+			break;
+		case ValueType::LIST: {
+			bool first = true;
+			buffer += json ? "[" : "";
+			for (std::string_view element : value.GetListView()) {
+				if (!first) {
+					buffer += json ? ", " : ",";
+				}
+				first = false;
+				AppendEscaped(element);
+			}
+			buffer += json ? "]" : "";
+			break;
+		}
+	}
+}
+
+void QueryWriter::AppendInteger(int64_t value) {
+	char digits[24];
+	auto result = std::to_chars(digits, digits + sizeof(digits), value);
+	buffer.append(digits, result.ptr);
+}
+
+void QueryWriter::AppendDouble(double value) {
+	if (format == QueryFormat::JSON && !std::isfinite(value)) {
+		// JSON has no infinities or NaN.
+		buffer += "null";
+		return;
+	}
+	// The shortest representation that reads back as the same double.
+	char digits[32];
+	auto result = std::to_chars(digits, digits + sizeof(digits), value);
+	buffer.append(digits, result.ptr);
+}
+
+void QueryWriter::AppendEscaped(std::string_view text) {
+	static const char HEX[] = "0123456789abcdef";
+	switch (format) {
+		case QueryFormat::TEXT:
+			buffer += text;
+			break;
+		case QueryFormat::TSV:
+			for (char c : text) {
+				switch (c) {
+					case '\t': buffer += "\\t"; break;
+					case '\n': buffer += "\\n"; break;
+					case '\r': buffer += "\\r"; break;
+					case '\\': buffer += "\\\\"; break;
+					default: buffer += c;
+				}
+			}
+			break;
+		case QueryFormat::JSON:
+			buffer += '"';
+			for (char c : text) {
+				switch (c) {
+					case '"': buffer += "\\\""; break;
+					case '\\': buffer += "\\\\"; break;
+					case '\n': buffer += "\\n"; break;
+					case '\r': buffer += "\\r"; break;
+					case '\t': buffer += "\\t"; break;
+					default:
+						if (static_cast<unsigned char>(c) < 0x20) {
+							buffer += "\\u00";
+							buffer += HEX[(c >> 4) & 0xF];
+							buffer += HEX[c & 0xF];
+						} else {
+							buffer += c;
+						}
+				}
+			}
+			buffer += '"';
+			break;
+	}
+}
+
+bool ParseQueryFormat(std::string_view name, QueryFormat& format) {
+	if (name == "text") {
+		format = QueryFormat::TEXT;
+	} else if (name == "tsv") {
+		format = QueryFormat::TSV;
+	} else if (name == "json") {
+		format = QueryFormat::JSON;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+} // namespace config
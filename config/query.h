@@ -0,0 +1,84 @@
+/*
+ * A QueryWriter object formats the results of many lookups, as done by
+ * "config_parser query", into a buffered output stream.
+ */
+
+#ifndef CONFIG_QUERY_H_
+#define CONFIG_QUERY_H_
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "store.h"
+
+namespace config {
+
+// For readability
+using std::string;
+
+// In every format, sizes and durations are written as a number of bytes
+// and nanoseconds, so that readers need no unit table.
+enum class QueryFormat {
+	// One value per line, lists joined with commas. Missing settings are
+	// written as empty lines, so that output lines match input keys.
+	TEXT,
+	// "key<TAB>type<TAB>value" per line, with tabs, newlines and backslashes
+	// in values escaped. The type of a missing setting is "none".
+	TSV,
+	// A single object mapping each key to its value, or to null if missing.
+	JSON
+};
+
+class QueryWriter {
+  private:
+	FILE* file;
+	const QueryFormat format;
+
+	// Output is formatted into this buffer, and written to the file when it
+	// is full, so that formatting a value allocates nothing after warm-up.
+	string buffer;
+
+	size_t count;
+	size_t missing;
+	bool finished;
+
+	void Flush();
+
+	// Append a value, in the format's syntax.
+	void AppendValue(const ItemView&);
+	void AppendInteger(int64_t);
+	void AppendDouble(double);
+	void AppendEscaped(std::string_view);
+
+  public:
+	// Output is written to the file once this many bytes are buffered.
+	static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+	// The file must stay open until Finish(). It is not closed.
+	QueryWriter(FILE*, QueryFormat);
+
+	// Calls Finish().
+	~QueryWriter();
+
+	QueryWriter(const QueryWriter&) = delete;
+	QueryWriter& operator=(const QueryWriter&) = delete;
+
+	// Write the result of looking up a key. An invalid view is written as a
+	// missing setting.
+	void Write(std::string_view, const ItemView&);
+
+	// Close the output (e.g. the JSON object) and flush it. Safe to call
+	// more than once. Returns false if writing to the file failed.
+	bool Finish();
+
+	// Number of keys written so far that were missing.
+	size_t Missing() const;
+};
+
+// Parse a format name: "text", "tsv" or "json". Returns false if unknown.
+bool ParseQueryFormat(std::string_view, QueryFormat&);
+
+} // namespace config
+
+#endif // CONFIG_QUERY_H_
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "../common/lest.hpp"
+#include "query.h"
+
+// Format lookups of the given keys into a string.
+std::string Query(const config::Store& store, config::QueryFormat format, const std::vector<std::string>& keys,
+	size_t* missing = NULL) {
+	char* data = NULL;
+	size_t size = 0;
+	FILE* file = open_memstream(&data, &size);
+	{
+		config::QueryWriter writer(file, format);
+		for (const auto& key : keys) {
+			writer.Write(key, store.Get(key));
+		}
+		writer.Finish();
+		if (missing != NULL) {
+			*missing = writer.Missing();
+		}
+	}
+	fclose(file);
+	std::string out(data, size);
+	free(data);
+	return out;
+}
+
+config::Item StringItem(const std::string& value) {
+	config::Item item;
+	item.SetString(value);
+	return item;
+}
+
+config::Store SampleStore() {
+	config::Handler handler;
+	handler.Load("sample.ini", {"production", "ubuntu"});
+	config::Store store;
+	store.Load(handler);
+	return store;
+}
+
+const lest::test specification[] = {
+	CASE("Text output has one value per key") {
+		config::Store store = SampleStore();
+		size_t missing = 0;
+		std::string out = Query(store, config::QueryFormat::TEXT,
+			{"ftp.path", "common.paid_users_size_limit", "ftp.enabled", "nope.nope", "http.params"}, &missing);
+		EXPECT(out == "/etc/var/uploads\n2147483648\nfalse\n\narray,of,values\n");
+		EXPECT(missing == 1u);
+	},
+
+	CASE("TSV output has the key, type and escaped value") {
+		config::Handler handler;
+		handler.Set("a.text", StringItem("tab\there\\"));
+		config::Item ratio;
+		ratio.SetDouble(0.25);
+		handler.Set("a.ratio", ratio);
+		config::Item limit;
+		limit.SetSize(1024);
+		handler.Set("a.limit", limit);
+		config::Item timeout;
+		timeout.SetDuration(std::chrono::seconds(2));
+		handler.Set("a.timeout", timeout);
+		config::Store store;
+		store.Load(handler);
+		std::string out = Query(store, config::QueryFormat::TSV, {"a.text", "a.ratio", "a.none"});
+		EXPECT(out == "a.text\tstring\ttab\\there\\\\\na.ratio\tdouble\t0.25\na.none\tnone\t\n");
+
+		// Sizes and durations are written in bytes and nanoseconds
+		out = Query(store, config::QueryFormat::TSV, {"a.limit", "a.timeout"});
+		EXPECT(out == "a.limit\tsize\t1024\na.timeout\tduration\t2000000000\n");
+	},
+
+	CASE("JSON output is one object") {
+		config::Store store = SampleStore();
+		EXPECT(Query(store, config::QueryFormat::JSON, {}) == "{}\n");
+		std::string out = Query(store, config::QueryFormat::JSON, {"ftp.name", "http.params", "ftp.enabled", "nope.nope"});
+		EXPECT(out == "{\n"
+			"  \"ftp.name\": \"hello there, ftp uploading\",\n"
+			"  \"http.params\": [\"array\", \"of\", \"values\"],\n"
+			"  \"ftp.enabled\": false,\n"
+			"  \"nope.nope\": null\n"
+			"}\n");
+
+		config::Handler handler;
+		handler.Set("a.quote", StringItem("say \"hi\"\n\x01"));
+		store.Load(handler);
+		EXPECT(Query(store, config::QueryFormat::JSON, {"a.quote"}) == "{\n  \"a.quote\": \"say \\\"hi\\\"\\n\\u0001\"\n}\n");
+	},
+
+	CASE("Large outputs are flushed as they grow") {
+		config::Store store = SampleStore();
+		std::vector<std::string> keys(20000, "ftp.name");
+		std::string out = Query(store, config::QueryFormat::TEXT, keys);
+		EXPECT(out.size() == 20000 * std::string("hello there, ftp uploading\n").size());
+	},
+
+	CASE("Format names are parsed") {
+		config::QueryFormat format;
+		EXPECT(config::ParseQueryFormat("json", format) == true);
+		EXPECT(format == config::QueryFormat::JSON);
+		EXPECT(config::ParseQueryFormat("tsv", format) == true);
+		EXPECT(format == config::QueryFormat::TSV);
+		EXPECT(config::ParseQueryFormat("yaml", format) == false);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
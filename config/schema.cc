@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include "errors.h"
+#include "parser.h"
+#include "schema.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace {
+
+const char* TypeName(ValueType type) {
+	switch (type) {
+		case ValueType::STRING:
+			return "string";
+		case ValueType::BOOLEAN:
+			return "boolean";
+		case ValueType::INTEGER:
+			return "integer";
+		case ValueType::DOUBLE:
+			return "double";
+		case ValueType::LIST:
+			return "list";
+		case ValueType::SIZE:
+			return "size";
+		case ValueType::DURATION:
+			return "duration";
+	}
+	return "none";
+}
+
+bool IsAmount(const Item& item) {
+	return item.GetValueType() == ValueType::SIZE || item.GetValueType() == ValueType::DURATION;
+}
+
+// The bytes or nanoseconds of a size or duration.
+int64_t Amount(const Item& item) {
+	return item.GetValueType() == ValueType::SIZE ? item.GetSize() : item.GetDuration().count();
+}
+
+// Compare two numeric items, or two sizes or durations, exactly if both are
+// integers. Returns <0, 0 or >0, like strcmp.
+int Compare(const Item& a, const Item& b) {
+	if (a.GetValueType() == ValueType::INTEGER && b.GetValueType() == ValueType::INTEGER) {
+		return a.GetInteger() < b.GetInteger() ? -1 : a.GetInteger() > b.GetInteger();
+	}
+	if (IsAmount(a)) {
+		return Amount(a) < Amount(b) ? -1 : Amount(a) > Amount(b);
+	}
+	double x = a.GetValueType() == ValueType::INTEGER ? static_cast<double>(a.GetInteger()) : a.GetDouble();
+	double y = b.GetValueType() == ValueType::INTEGER ? static_cast<double>(b.GetInteger()) : b.GetDouble();
+	return x < y ? -1 : x > y;
+}
+
+bool IsNumber(const Item& item) {
+	return item.GetValueType() == ValueType::INTEGER || item.GetValueType() == ValueType::DOUBLE;
+}
+
+// Whether Compare can order two items: two numbers, two sizes or two
+// durations.
+bool Comparable(const Item& a, const Item& b) {
+	return (IsNumber(a) && IsNumber(b)) || (IsAmount(a) && a.GetValueType() == b.GetValueType());
+}
+
+// The texts an enum or pattern rule checks: a string's characters, each
+// element of a list, or other values as they would be written in a file.
+vector<string> Texts(const Item& item) {
+	switch (item.GetValueType()) {
+		case ValueType::STRING:
+			return {item.GetString()};
+		case ValueType::LIST:
+			return item.GetList();
+		default:
+			return {Parser().FormatValue(item)};
+	}
+}
+
+} // namespace
+
+Schema::Schema() {}
+
+Schema::Schema(const string& filename) {
+	config::Parser parser;
+	string section = "";
+	for (const string& raw : parser.ParseFile(filename)) {
+		string line = parser.StripLine(raw);
+		if (line.empty()) {
+			continue;
+		}
+		if (parser.IsValidSection(line)) {
+			section = parser.ParseSection(line);
+			continue;
+		}
+		config::SettingView setting = parser.ParseSettingView(line, section);
+		if (setting.key == "" || setting.override == "") {
+			throw std::runtime_error(errors::SCHEMA_RULE);
+		}
+
+		// Group the rule with the others of its section and key.
+		auto index = sectionIndex.emplace(section, sections.size());
+		if (index.second) {
+			sections.push_back({section, {}});
+		}
+		vector<Rule>& rules = sections[index.first->second].second;
+		string key = section + "." + string(setting.key);
+		auto rule = std::find_if(rules.begin(), rules.end(), [&](const Rule& rule) { return rule.key == key; });
+		if (rule == rules.end()) {
+			rules.push_back(Rule());
+			rule = rules.end() - 1;
+			rule->key = key;
+			ruleCount++;
+		}
+
+		Item value = parser.ConstructValueObject(setting.value);
+		std::string_view name = setting.override;
+		if (name == "required" && value.GetValueType() == ValueType::BOOLEAN) {
+			rule->required = value.GetBoolean();
+		} else if (name == "type" && value.GetValueType() == ValueType::STRING) {
+			for (ValueType type : {ValueType::STRING, ValueType::BOOLEAN, ValueType::INTEGER, ValueType::DOUBLE,
+					ValueType::LIST, ValueType::SIZE, ValueType::DURATION}) {
+				if (value.GetString() == TypeName(type)) {
+					rule->type = type;
+				}
+			}
+			if (!rule->type) {
+				throw std::runtime_error(errors::SCHEMA_RULE);
+			}
+		} else if (name == "min" && (IsNumber(value) || IsAmount(value)) && (!rule->max || Comparable(value, *rule->max))) {
+			rule->min = value;
+		} else if (name == "max" && (IsNumber(value) || IsAmount(value)) && (!rule->min || Comparable(value, *rule->min))) {
+			rule->max = value;
+		} else if (name == "enum") {
+			for (string& allowed : Texts(value)) {
+				rule->allowed.insert(std::move(allowed));
+			}
+		} else if (name == "pattern" && value.GetValueType() == ValueType::STRING) {
+			try {
+				rule->pattern.emplace(value.GetString(), std::regex::ECMAScript | std::regex::optimize);
+			} catch (const std::regex_error&) {
+				throw std::runtime_error(errors::SCHEMA_RULE);
+			}
+		} else {
+			throw std::runtime_error(errors::SCHEMA_RULE);
+		}
+	}
+}
+
+size_t Schema::Size() const {
+	return ruleCount;
+}
+
+void Schema::Check(const Rule& rule, const Item* item, vector<SchemaViolation>& violations) const {
+	auto violate = [&](string message) {
+		violations.push_back(SchemaViolation{rule.key, std::move(message)});
+	};
+	if (item == NULL) {
+		if (rule.required) {
+			violate("is required");
+		}
+		return;
+	}
+	if (rule.type && item->GetValueType() != *rule.type) {
+		violate(string("must be of type ") + TypeName(*rule.type) + ", not " + TypeName(item->GetValueType()));
+		return;
+	}
+	if (rule.min || rule.max) {
+		const Item& bound = rule.min ? *rule.min : *rule.max;
+		if (!Comparable(*item, bound)) {
+			violate(IsNumber(bound) ? "must be a number" : string("must be a ") + TypeName(bound.GetValueType()));
+			return;
+		}
+		if (rule.min && Compare(*item, *rule.min) < 0) {
+			violate("must be at least " + Parser().FormatValue(*rule.min));
+		}
+		if (rule.max && Compare(*item, *rule.max) > 0) {
+			violate("must be at most " + Parser().FormatValue(*rule.max));
+		}
+	}
+	if (!rule.allowed.empty() || rule.pattern) {
+		for (const string& text : Texts(*item)) {
+			if (!rule.allowed.empty() && rule.allowed.count(text) == 0) {
+				violate("has a value not in its enum: " + text);
+			}
+			if (rule.pattern && !std::regex_match(text, *rule.pattern)) {
+				violate("has a value that does not match its pattern: " + text);
+			}
+		}
+	}
+}
+
+vector<SchemaViolation> Schema::Check(const vector<size_t>& positions,
+	const std::function<const Item*(std::string_view)>& find) const {
+	auto checkSections = [&](size_t begin, size_t end, vector<SchemaViolation>& violations) {
+		for (size_t i = begin; i < end; i++) {
+			for (const Rule& rule : sections[positions[i]].second) {
+				Check(rule, find(rule.key), violations);
+			}
+		}
+	};
+
+	size_t rules = 0;
+	for (size_t position : positions) {
+		rules += sections[position].second.size();
+	}
+	size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), positions.size());
+	vector<SchemaViolation> violations;
+	if (rules < PARALLEL_RULES || threads < 2) {
+		checkSections(0, positions.size(), violations);
+		return violations;
+	}
+
+	// Split the sections into contiguous runs of about as many rules each,
+	// one per thread, with the calling thread taking the first.
+	vector<size_t> bounds = {0};
+	size_t counted = 0;
+	for (size_t i = 0; i < positions.size() && bounds.size() < threads; i++) {
+		counted += sections[positions[i]].second.size();
+		if (counted >= rules * bounds.size() / threads) {
+			bounds.push_back(i + 1);
+		}
+	}
+	bounds.push_back(positions.size());
+	// An exception escaping a worker would terminate the process, so each
+	// run keeps its own, and the first is rethrown here once all are joined.
+	vector<vector<SchemaViolation>> found(bounds.size() - 1);
+	vector<std::exception_ptr> failures(found.size());
+	auto checkRun = [&](size_t run) {
+		try {
+			checkSections(bounds[run], bounds[run + 1], found[run]);
+		} catch (...) {
+			failures[run] = std::current_exception();
+		}
+	};
+	vector<std::thread> workers;
+	for (size_t run = 1; run < found.size(); run++) {
+		workers.emplace_back(checkRun, run);
+	}
+	checkRun(0);
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	for (const std::exception_ptr& failure : failures) {
+		if (failure) {
+			std::rethrow_exception(failure);
+		}
+	}
+	for (auto& part : found) {
+		violations.insert(violations.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+	}
+	return violations;
+}
+
+vector<SchemaViolation> Schema::Validate(const std::function<const Item*(std::string_view)>& find) const {
+	vector<size_t> positions(sections.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		positions[i] = i;
+	}
+	return Check(positions, find);
+}
+
+vector<SchemaViolation> Schema::Validate(const std::function<const Item*(std::string_view)>& find,
+	const vector<string>& names) const {
+	vector<size_t> positions;
+	for (const string& name : names) {
+		auto it = sectionIndex.find(name);
+		if (it != sectionIndex.end()) {
+			positions.push_back(it->second);
+		}
+	}
+	std::sort(positions.begin(), positions.end());
+	positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+	return Check(positions, find);
+}
+
+} // namespace config
@@ -0,0 +1,114 @@
+/*
+ * A Schema object holds the rules a config must follow, compiled from a
+ * schema file, and checks settings against them.
+ *
+ * A schema is itself an ini file. Each rule is a setting of the section and
+ * key it applies to, with the rule as its override tag:
+ *
+ *   [common]
+ *   paid_users_size_limit<required> = yes
+ *   paid_users_size_limit<type> = integer
+ *   paid_users_size_limit<min> = 0
+ *
+ *   [ftp]
+ *   path<required> = yes
+ *   path<pattern> = "/.*"
+ *   mode<enum> = active,passive
+ *
+ * The rules are:
+ *   required  yes or no. Settings are optional by default.
+ *   type      string, boolean, integer, double, list, size or duration.
+ *   min, max  Inclusive bounds of an integer or double value, or of a size
+ *             or duration, e.g. 1MiB or 30s.
+ *   enum      The values allowed, as a list, or a single value.
+ *   pattern   A regular expression (ECMAScript) that the whole value must
+ *             match, or every element of a list.
+ * Every rule but required only applies to settings that are present. Enum
+ * and pattern rules compare the value as it would be written in a file,
+ * without quotes.
+ */
+
+#ifndef CONFIG_SCHEMA_H_
+#define CONFIG_SCHEMA_H_
+
+#include <functional>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "item.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// A setting that breaks a rule of a schema.
+struct SchemaViolation {
+	// The "section.key" name of the setting.
+	string key;
+	string message;
+};
+
+class Schema {
+  private:
+	// The compiled rules of one setting.
+	struct Rule {
+		string key;
+		bool required = false;
+		std::optional<ValueType> type;
+		std::optional<Item> min;
+		std::optional<Item> max;
+		std::unordered_set<string> allowed;
+		std::optional<std::regex> pattern;
+	};
+
+	// Rules grouped by section, in the order the sections first appear in
+	// the schema, and the position of each section by name.
+	vector<std::pair<string, vector<Rule>>> sections;
+	unordered_map<string, size_t> sectionIndex;
+	size_t ruleCount = 0;
+
+	// Check one setting, or NULL if it is missing, against its rules.
+	void Check(const Rule&, const Item*, vector<SchemaViolation>&) const;
+
+	// Check the sections at the given positions, in parallel if there are
+	// enough rules to be worth it. Exceptions on any thread are rethrown on
+	// the calling one.
+	vector<SchemaViolation> Check(const vector<size_t>&, const std::function<const Item*(std::string_view)>&) const;
+
+  public:
+	// Below this many rules, checking them all on the calling thread is
+	// faster than starting threads.
+	static constexpr size_t PARALLEL_RULES = 4096;
+
+	// A schema without rules.
+	Schema();
+
+	// Compile a schema file. Throws if it cannot be opened, or has a
+	// malformed line, an unknown rule, or an invalid rule value or pattern.
+	explicit Schema(const string&);
+
+	// Number of settings with rules.
+	size_t Size() const;
+
+	// Check every setting with rules, looking each one up by its
+	// "section.key" name. The lookup must return NULL for missing settings,
+	// and be safe to call from several threads at once. Returns the
+	// violations, grouped by section in schema order; empty if there are none.
+	vector<SchemaViolation> Validate(const std::function<const Item*(std::string_view)>&) const;
+
+	// Same as above, but only checks the rules of the named sections.
+	vector<SchemaViolation> Validate(const std::function<const Item*(std::string_view)>&,
+		const vector<string>&) const;
+};
+
+} // namespace config
+
+#endif // CONFIG_SCHEMA_H_
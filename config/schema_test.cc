@@ -0,0 +1,211 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "../common/lest.hpp"
+#include "handler.h"
+#include "schema.h"
+
+// Replace the contents of a file.
+void WriteFile(const std::string& filename, const std::string& contents) {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	file << contents;
+}
+
+std::string TemporaryFile(const std::string& name) {
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+const std::string kSchema =
+	"[common]\n"
+	"paid_users_size_limit<required> = yes\n"
+	"paid_users_size_limit<type> = integer\n"
+	"paid_users_size_limit<min> = 0\n"
+	"ratio<max> = 1.5\n"
+	"[ftp]\n"
+	"path<required> = yes\n"
+	"path<pattern> = \"/[a-z/]*\"\n"
+	"mode<enum> = active,passive\n"
+	"params<type> = list\n"
+	"params<enum> = a,b,c\n";
+
+const lest::test specification[] = {
+	CASE("A schema reports every broken rule") {
+		std::string schemaFile = TemporaryFile("config_schema_test_schema.ini");
+		WriteFile(schemaFile, kSchema);
+		config::Schema schema(schemaFile);
+		EXPECT(schema.Size() == 5u);
+
+		std::string filename = TemporaryFile("config_schema_test.ini");
+		config::Handler handler;
+		auto lookup = [&](std::string_view key) { return handler.Find(key); };
+
+		WriteFile(filename, "[common]\npaid_users_size_limit = 10\nratio = 1.5\n[ftp]\npath = /srv/ftp\nmode = passive\nparams = a,c\n");
+		EXPECT(handler.Load(filename, {}) == true);
+		EXPECT(schema.Validate(lookup).empty());
+
+		config::Handler bad;
+		WriteFile(filename, "[common]\npaid_users_size_limit = -1\nratio = 2\n[ftp]\nmode = pasive\nparams = a,d\n");
+		EXPECT(bad.Load(filename, {}) == true);
+		std::vector<config::SchemaViolation> violations = schema.Validate([&](std::string_view key) { return bad.Find(key); });
+		EXPECT(violations.size() == 5u);
+		EXPECT(violations[0].key == "common.paid_users_size_limit");
+		EXPECT(violations[0].message == "must be at least 0");
+		EXPECT(violations[1].key == "common.ratio");
+		EXPECT(violations[2].key == "ftp.path");
+		EXPECT(violations[2].message == "is required");
+		EXPECT(violations[3].key == "ftp.mode");
+		EXPECT(violations[4].key == "ftp.params");
+
+		// Types are checked before anything else
+		WriteFile(filename, "[common]\npaid_users_size_limit = \"10\"\n[ftp]\npath = /Upper\n");
+		bad = config::Handler();
+		EXPECT(bad.Load(filename, {}) == true);
+		violations = schema.Validate([&](std::string_view key) { return bad.Find(key); }, {"common", "ftp", "none"});
+		EXPECT(violations.size() == 2u);
+		EXPECT(violations[0].message == "must be of type integer, not string");
+		EXPECT(violations[1].key == "ftp.path");
+
+		// Only the named sections are checked
+		EXPECT(schema.Validate([&](std::string_view key) { return bad.Find(key); }, {"common"}).size() == 1u);
+
+		std::filesystem::remove(filename);
+		std::filesystem::remove(schemaFile);
+	},
+
+	CASE("Malformed schemas do not compile") {
+		std::string schemaFile = TemporaryFile("config_schema_test_malformed.ini");
+		for (std::string rules : {"[a]\nb = 1\n", "[a]\nb<type> = text\n", "[a]\nb<min> = low\n", "[a]\nb<color> = red\n",
+				"[a]\nb<pattern> = \"(\"\n", "[a]\nbad\n", "[a]\nb<min> = 1s\nb<max> = 1MiB\n"}) {
+			WriteFile(schemaFile, rules);
+			EXPECT_THROWS_AS(config::Schema{schemaFile}, std::runtime_error);
+		}
+		std::filesystem::remove(schemaFile);
+		EXPECT_THROWS_AS(config::Schema{schemaFile}, std::runtime_error);
+	},
+
+	CASE("Sizes and durations are bounded in their own units") {
+		std::string schemaFile = TemporaryFile("config_schema_test_units_schema.ini");
+		WriteFile(schemaFile, "[upload]\nlimit<type> = size\nlimit<max> = 1GiB\ntimeout<min> = 100ms\ntimeout<max> = 1m\n");
+		config::Schema schema(schemaFile);
+		std::string filename = TemporaryFile("config_schema_test_units.ini");
+
+		config::Handler handler;
+		WriteFile(filename, "[upload]\nlimit = 1024MiB\ntimeout = 60s\n");
+		EXPECT(handler.Load(filename, {}) == true);
+		EXPECT(schema.Validate([&](std::string_view key) { return handler.Find(key); }).empty());
+
+		config::Handler bad;
+		WriteFile(filename, "[upload]\nlimit = 1025MiB\ntimeout = 100\n");
+		EXPECT(bad.Load(filename, {}) == true);
+		std::vector<config::SchemaViolation> violations = schema.Validate([&](std::string_view key) { return bad.Find(key); });
+		EXPECT(violations.size() == 2u);
+		EXPECT(violations[0].message == "must be at most 1GiB");
+		EXPECT(violations[1].message == "must be a duration");
+
+		std::filesystem::remove(filename);
+		std::filesystem::remove(schemaFile);
+	},
+
+	CASE("Loads that break a schema are invalid") {
+		std::string schemaFile = TemporaryFile("config_schema_test_load_schema.ini");
+		WriteFile(schemaFile, kSchema);
+		std::string filename = TemporaryFile("config_schema_test_load.ini");
+		std::string common = "[common]\npaid_users_size_limit = 10\n";
+
+		config::Handler handler;
+		handler.SetSchema(std::make_shared<const config::Schema>(schemaFile));
+		WriteFile(filename, common + "[ftp]\npath = /a\n");
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.GetViolations().empty());
+
+		// Incremental reloads check the sections they change, and keep the
+		// previous settings if a rule is broken
+		WriteFile(filename, common + "[ftp]\npath = /b\nmode = off\n");
+		EXPECT(handler.Reload(filename, {}) == config::INVALID);
+		EXPECT(handler.GetViolations().size() == 1u);
+		EXPECT(handler.GetViolations()[0].key == "ftp.mode");
+		EXPECT(handler.GetString("ftp.path", "") == "/a");
+
+		// Removing a required setting breaks a rule too
+		WriteFile(filename, common);
+		EXPECT(handler.Reload(filename, {}) == config::INVALID);
+		EXPECT(handler.GetViolations()[0].message == "is required");
+
+		// So do values expanded from changed settings in other sections
+		WriteFile(filename, common + "path = /c\n[ftp]\npath = ${common.path}\n");
+		EXPECT(handler.Reload(filename, {}) == config::RELOADED);
+		EXPECT(handler.GetViolations().empty());
+		WriteFile(filename, common + "path = /C\n[ftp]\npath = ${common.path}\n");
+		EXPECT(handler.Reload(filename, {}) == config::INVALID);
+		EXPECT(handler.GetString("ftp.path", "") == "/c");
+
+		// Full parses too
+		EXPECT(handler.Reload(filename, {"x"}) == config::INVALID);
+		EXPECT(handler.GetViolations().size() == 1u);
+		config::Handler fresh;
+		fresh.SetSchema(std::make_shared<const config::Schema>(schemaFile));
+		EXPECT(fresh.Load(filename, {}) == false);
+		EXPECT(fresh.Find("ftp.path") == nullptr);
+
+		// A load that breaks a rule leaves the settings of the last one
+		WriteFile(filename, common + "[ftp]\npath = /d\n");
+		EXPECT(fresh.Load(filename, {}) == true);
+		WriteFile(filename, common + "[ftp]\npath = /e\nmode = off\n");
+		EXPECT(fresh.Load(filename, {}) == false);
+		EXPECT(fresh.GetViolations()[0].key == "ftp.mode");
+		EXPECT(fresh.GetString("ftp.path", "") == "/d");
+		EXPECT(fresh.Find("ftp.mode") == nullptr);
+
+		std::filesystem::remove(filename);
+		std::filesystem::remove(schemaFile);
+	},
+
+	CASE("Large schemas are checked in parallel with the same result") {
+		// Enough sections and rules to be split across threads.
+		std::string schemaText;
+		std::string configText;
+		for (int section = 0; section < 100; section++) {
+			std::string name = "s" + std::to_string(section);
+			schemaText += "[" + name + "]\n";
+			configText += "[" + name + "]\n";
+			for (int key = 0; key < 50; key++) {
+				std::string k = "k" + std::to_string(key);
+				schemaText += k + "<type> = integer\n" + k + "<max> = 100\n";
+				configText += k + " = " + std::to_string((section * 50 + key) % 997 == 0 ? 101 : key) + "\n";
+			}
+		}
+		std::string schemaFile = TemporaryFile("config_schema_test_large_schema.ini");
+		std::string filename = TemporaryFile("config_schema_test_large.ini");
+		WriteFile(schemaFile, schemaText);
+		WriteFile(filename, configText);
+
+		config::Schema schema(schemaFile);
+		EXPECT(schema.Size() >= config::Schema::PARALLEL_RULES);
+		config::Handler handler;
+		EXPECT(handler.Load(filename, {}) == true);
+		std::vector<config::SchemaViolation> violations = schema.Validate([&](std::string_view key) { return handler.Find(key); });
+		EXPECT(violations.size() == 6u);
+		EXPECT(violations[0].key == "s0.k0");
+		EXPECT(violations[5].key == "s99.k35");
+
+		// Errors on any thread reach the caller
+		auto failing = [&](std::string_view key) -> const config::Item* {
+			if (key == "s99.k49") {
+				throw std::runtime_error("lookup failed");
+			}
+			return handler.Find(key);
+		};
+		EXPECT_THROWS_AS(schema.Validate(failing), std::runtime_error);
+
+		std::filesystem::remove(filename);
+		std::filesystem::remove(schemaFile);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -0,0 +1,199 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "errors.h"
+#include "shared.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::vector;
+
+namespace {
+
+const uint64_t CONTROL_MAGIC = 0x314C5254434643ULL; // "CFCTRL1"
+
+// The name of the segment holding one generation of an image.
+string SegmentName(const string& name, uint64_t generation) {
+	return name + "." + std::to_string(generation);
+}
+
+// Write a whole buffer to a descriptor. Returns false on error.
+bool WriteAll(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		size -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+} // namespace
+
+SharedPublisher::SharedPublisher(const string& name) : name(name), control(NULL) {
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+	if (ftruncate(fd, sizeof(SharedControl)) != 0) {
+		close(fd);
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+	void* mapped = mmap(NULL, sizeof(SharedControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+	control = static_cast<SharedControl*>(mapped);
+
+	// A new segment is zero-filled. An existing one was left by an earlier
+	// publisher, whose generations this one continues.
+	if (control->magic != CONTROL_MAGIC) {
+		control->generation.store(0, std::memory_order_relaxed);
+		control->magic = CONTROL_MAGIC;
+	}
+}
+
+SharedPublisher::~SharedPublisher() {
+	munmap(control, sizeof(SharedControl));
+}
+
+uint64_t SharedPublisher::Publish(const Handler& handler) {
+	uint64_t previous = control->generation.load(std::memory_order_acquire);
+	uint64_t generation = previous + 1;
+
+	vector<uint64_t> buffer;
+	Image::Build(handler, generation, buffer);
+
+	// Remove any segment a crashed publisher may have left under this name.
+	string segment = SegmentName(name, generation);
+	shm_unlink(segment.c_str());
+	int fd = shm_open(segment.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+	bool written = WriteAll(fd, reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(uint64_t));
+	close(fd);
+	if (!written) {
+		shm_unlink(segment.c_str());
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+
+	// The image is complete before readers can see its generation.
+	control->generation.store(generation, std::memory_order_release);
+
+	// Unlinking only removes the name; mappings of readers that have not
+	// refreshed yet stay valid until they are unmapped.
+	if (previous > 0) {
+		shm_unlink(SegmentName(name, previous).c_str());
+	}
+	return generation;
+}
+
+void SharedPublisher::Unlink() {
+	uint64_t generation = control->generation.load(std::memory_order_acquire);
+	if (generation > 0) {
+		shm_unlink(SegmentName(name, generation).c_str());
+	}
+	shm_unlink(name.c_str());
+}
+
+SharedReader::SharedReader(const string& name)
+	: name(name), control(NULL), mapping(NULL), mappingSize(0) {
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+	// A publisher creates the segment before sizing it. Mapping it in
+	// between would fault on the first read, so check its size first.
+	struct stat info;
+	if (fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) < sizeof(SharedControl)) {
+		close(fd);
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+	void* mapped = mmap(NULL, sizeof(SharedControl), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error(errors::SHARED_MEMORY);
+	}
+	control = static_cast<const SharedControl*>(mapped);
+	Refresh();
+}
+
+SharedReader::~SharedReader() {
+	Unmap();
+	munmap(const_cast<SharedControl*>(control), sizeof(SharedControl));
+}
+
+void SharedReader::Unmap() {
+	if (mapping != NULL) {
+		munmap(const_cast<void*>(mapping), mappingSize);
+		mapping = NULL;
+		mappingSize = 0;
+	}
+	image = Image();
+}
+
+bool SharedReader::Refresh() {
+	// A publish may unlink the segment between reading its generation and
+	// opening it; try again with the newer generation.
+	for (int attempt = 0; attempt < 3; attempt++) {
+		uint64_t generation = control->generation.load(std::memory_order_acquire);
+		if (control->magic != CONTROL_MAGIC || generation == 0 || generation == Generation()) {
+			return false;
+		}
+		int fd = shm_open(SegmentName(name, generation).c_str(), O_RDONLY, 0);
+		if (fd < 0) {
+			continue;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+			close(fd);
+			return false;
+		}
+		size_t size = static_cast<size_t>(info.st_size);
+		void* mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			return false;
+		}
+
+		Image next;
+		if (!next.Attach(mapped, size) || next.Generation() != generation) {
+			munmap(mapped, size);
+			return false;
+		}
+		Unmap();
+		mapping = mapped;
+		mappingSize = size;
+		image = next;
+		return true;
+	}
+	return false;
+}
+
+ItemView SharedReader::Get(const string& key) const {
+	return ItemView::Of(image, image.Find(key));
+}
+
+uint64_t SharedReader::Generation() const {
+	return image.Generation();
+}
+
+size_t SharedReader::Size() const {
+	return image.Size();
+}
+
+} // namespace config
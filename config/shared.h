@@ -0,0 +1,105 @@
+/*
+ * SharedPublisher and SharedReader share a loaded config between processes
+ * on one host through POSIX shared memory. The publisher parses the config
+ * once and writes it as an Image; readers map the image read-only and serve
+ * lookups straight from it.
+ */
+
+#ifndef CONFIG_SHARED_H_
+#define CONFIG_SHARED_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "handler.h"
+#include "image.h"
+#include "store.h"
+
+namespace config {
+
+// For readability
+using std::string;
+
+// The control segment, named after the config, that points readers at the
+// current image. Each image is published in a segment of its own, named
+// "<name>.<generation>".
+struct SharedControl {
+	uint64_t magic;
+	std::atomic<uint64_t> generation;
+};
+
+// Atomics in shared memory must not rely on a process-local lock.
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "generation must be lock-free");
+
+class SharedPublisher {
+  private:
+	const string name;
+	SharedControl* control;
+
+  public:
+	// Open or create the control segment of a config. Names must start with
+	// a '/' and contain no other, e.g. "/myapp-config". Throws if the
+	// segment cannot be created. Only one publisher may use a name at a time.
+	explicit SharedPublisher(const string&);
+
+	// Unmaps the control segment, but leaves the current image published.
+	~SharedPublisher();
+
+	SharedPublisher(const SharedPublisher&) = delete;
+	SharedPublisher& operator=(const SharedPublisher&) = delete;
+
+	// Write every setting of a handler into a new image segment, switch
+	// readers to it atomically, and unlink the previous one. Readers that
+	// still map the previous image keep it until they refresh; the system
+	// frees it once the last of them has unmapped it. Returns the generation
+	// of the new image. Throws if the segment cannot be written.
+	uint64_t Publish(const Handler&);
+
+	// Unlink the control segment and the current image, e.g. on shutdown.
+	void Unlink();
+};
+
+class SharedReader {
+  private:
+	const string name;
+	const SharedControl* control;
+
+	// The mapped image segment, if any.
+	const void* mapping;
+	size_t mappingSize;
+	Image image;
+
+	void Unmap();
+
+  public:
+	// Map the control segment of a config, and the current image if one was
+	// published. Throws if the control segment does not exist, or was not
+	// sized by its publisher yet.
+	explicit SharedReader(const string&);
+
+	~SharedReader();
+
+	SharedReader(const SharedReader&) = delete;
+	SharedReader& operator=(const SharedReader&) = delete;
+
+	// Switch to the latest image if a newer one was published. Returns true
+	// if it switched. Views obtained before a switch become invalid, so a
+	// reader should only be used by one thread at a time. Checking for a
+	// new generation is a single atomic load, cheap enough for every request.
+	bool Refresh();
+
+	// Get a view of an individual setting in the current image. Returns an
+	// invalid view if not found, or if nothing was published yet.
+	ItemView Get(const string&) const;
+
+	// The generation of the current image, or 0 if nothing is mapped.
+	uint64_t Generation() const;
+
+	// Number of items in the current image.
+	size_t Size() const;
+};
+
+} // namespace config
+
+#endif // CONFIG_SHARED_H_
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../common/lest.hpp"
+#include "shared.h"
+
+// A segment name unique to this test run.
+std::string SegmentName(const std::string& suffix) {
+	return "/config_shared_test_" + std::to_string(getpid()) + "_" + suffix;
+}
+
+const lest::test specification[] = {
+	CASE("Images find every setting and reject corrupt data") {
+		config::Handler handler;
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}) == true);
+
+		std::vector<uint64_t> buffer;
+		config::Image::Build(handler, 7, buffer);
+		config::Image image;
+		EXPECT(image.Attach(buffer.data(), buffer.size() * sizeof(uint64_t)) == true);
+		EXPECT(image.Size() == 10u);
+		EXPECT(image.Generation() == 7u);
+		uint32_t slot = image.Find("ftp.path");
+		EXPECT(slot != config::Image::NOT_FOUND);
+		EXPECT(image.Key(slot) == "ftp.path");
+		EXPECT(image.Find("ftp.foobar123") == config::Image::NOT_FOUND);
+
+		// Images are position-independent
+		std::vector<uint64_t> copy = buffer;
+		config::Image moved;
+		EXPECT(moved.Attach(copy.data(), copy.size() * sizeof(uint64_t)) == true);
+		EXPECT(config::ItemView::Of(moved, moved.Find("ftp.path")).GetString() == "/etc/var/uploads");
+
+		// Truncated or corrupt images are rejected
+		EXPECT(image.Attach(buffer.data(), buffer.size() * sizeof(uint64_t) - 8) == false);
+		EXPECT(image.Size() == 0u);
+		copy[0] = 0;
+		EXPECT(image.Attach(copy.data(), copy.size() * sizeof(uint64_t)) == false);
+		EXPECT(image.Attach(NULL, 0) == false);
+
+		// So are tables without a free entry, where lookups would never stop
+		copy = buffer;
+		const config::ImageHeader* header = reinterpret_cast<const config::ImageHeader*>(copy.data());
+		uint32_t* table = reinterpret_cast<uint32_t*>(reinterpret_cast<char*>(copy.data()) + header->tableOffset);
+		std::fill(table, table + header->tableSize, 0);
+		EXPECT(image.Attach(copy.data(), copy.size() * sizeof(uint64_t)) == false);
+	},
+
+	CASE("Readers refuse a control segment that was not sized yet") {
+		// As a publisher leaves it between creating and sizing it
+		std::string name = SegmentName("unsized");
+		int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+		EXPECT(fd >= 0);
+		close(fd);
+		EXPECT_THROWS_AS(config::SharedReader{name}, std::runtime_error);
+		shm_unlink(name.c_str());
+	},
+
+	CASE("Readers serve settings published by another process") {
+		std::string name = SegmentName("publish");
+		config::SharedPublisher publisher(name);
+		config::SharedReader reader(name);
+		EXPECT(reader.Generation() == 0u);
+		EXPECT(reader.Get("ftp.path").IsValid() == false);
+		EXPECT(reader.Refresh() == false);
+
+		// Publish from a child process
+		pid_t child = fork();
+		if (child == 0) {
+			config::Handler handler;
+			handler.Load("sample.ini", {"production", "ubuntu"});
+			config::SharedPublisher childPublisher(name);
+			childPublisher.Publish(handler);
+			_exit(0);
+		}
+		int status = 0;
+		waitpid(child, &status, 0);
+		EXPECT(WIFEXITED(status));
+
+		EXPECT(reader.Refresh() == true);
+		EXPECT(reader.Generation() == 1u);
+		EXPECT(reader.Size() == 10u);
+		EXPECT(reader.Get("ftp.path").GetString() == "/etc/var/uploads");
+		EXPECT(reader.Get("common.paid_users_size_limit").GetInteger() == 2147483648);
+		EXPECT(reader.Get("http.params").GetListView()[2] == "values");
+		EXPECT(reader.Refresh() == false);
+
+		// A new generation replaces the old one atomically
+		config::Handler staging;
+		EXPECT(staging.Load("sample.ini", {"staging"}) == true);
+		EXPECT(publisher.Publish(staging) == 2u);
+		config::SharedReader late(name);
+		EXPECT(late.Generation() == 2u);
+		EXPECT(late.Get("ftp.path").GetString() == "/srv/uploads/");
+
+		// The old generation stays readable until the reader refreshes, but
+		// is no longer reachable by name
+		EXPECT(reader.Get("ftp.path").GetString() == "/etc/var/uploads");
+		EXPECT(shm_open((name + ".1").c_str(), O_RDONLY, 0) == -1);
+		EXPECT(reader.Refresh() == true);
+		EXPECT(reader.Get("ftp.path").GetString() == "/srv/uploads/");
+
+		publisher.Unlink();
+		EXPECT_THROWS_AS(config::SharedReader{name}, std::runtime_error);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
@@ -0,0 +1,167 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "errors.h"
+#include "store.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+bool ItemView::IsValid() const {
+	return image != NULL;
+}
+
+ItemView ItemView::Of(const Image& image, uint32_t slot) {
+	ItemView view;
+	view.image = NULL;
+	view.slot = 0;
+	if (slot != Image::NOT_FOUND) {
+		view.image = &image;
+		view.slot = slot;
+	}
+	return view;
+}
+
+ValueType ItemView::GetValueType() const {
+	return static_cast<ValueType>(image->types[slot]);
+}
+
+string ItemView::GetString() const {
+	return string(GetStringView());
+}
+
+bool ItemView::GetBoolean() const {
+	if (image->types[slot] != ValueType::BOOLEAN) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	return image->scalars[slot] != 0;
+}
+
+int64_t ItemView::GetInteger() const {
+	if (image->types[slot] != ValueType::INTEGER) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	// Bit-cast the payload back; memcpy is the portable way to do this.
+	int64_t out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return out;
+}
+
+double ItemView::GetDouble() const {
+	if (image->types[slot] != ValueType::DOUBLE) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	double out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return out;
+}
+
+int64_t ItemView::GetSize() const {
+	if (image->types[slot] != ValueType::SIZE) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	int64_t out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return out;
+}
+
+std::chrono::nanoseconds ItemView::GetDuration() const {
+	if (image->types[slot] != ValueType::DURATION) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	int64_t out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return std::chrono::nanoseconds(out);
+}
+
+vector<string> ItemView::GetList() const {
+	ListView list = GetListView();
+	vector<string> out;
+	out.reserve(list.size());
+	for (const auto& element : list) {
+		out.push_back(string(element));
+	}
+	return out;
+}
+
+std::string_view ItemView::GetStringView() const {
+	if (image->types[slot] != ValueType::STRING) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	const Span& span = image->spans[slot];
+	return std::string_view(image->arena + span.offset, span.length);
+}
+
+ListView ItemView::GetListView() const {
+	if (image->types[slot] != ValueType::LIST) {
+		throw std::runtime_error(errors::TYPE_MISMATCH);
+	}
+	const Span& span = image->spans[slot];
+	return ListView(image->arena, image->listSpans + span.offset, span.length);
+}
+
+Store::Store() {}
+
+Store::Store(const Store& other) : buffer(other.buffer) {
+	image.Attach(buffer.data(), buffer.size() * sizeof(uint64_t));
+}
+
+Store& Store::operator=(const Store& other) {
+	if (this != &other) {
+		buffer = other.buffer;
+		image.Attach(buffer.data(), buffer.size() * sizeof(uint64_t));
+	}
+	return *this;
+}
+
+void Store::Load(const Handler& handler) {
+	Image::Build(handler, 0, buffer);
+	image.Attach(buffer.data(), buffer.size() * sizeof(uint64_t));
+}
+
+void Store::Save(const string& filename) const {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(uint64_t));
+	if (!file) {
+		throw std::runtime_error(errors::FILE_OPEN);
+	}
+}
+
+bool Store::Open(const string& filename) {
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error(errors::FILE_OPEN);
+	}
+	std::streamoff size = file.tellg();
+	file.seekg(0);
+	// Read into 8-byte words, so that the arrays are aligned wherever the
+	// snapshot was written.
+	buffer.assign((static_cast<size_t>(size) + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+	if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
+		throw std::runtime_error(errors::FILE_OPEN);
+	}
+	if (!image.Attach(buffer.data(), static_cast<size_t>(size))) {
+		buffer.clear();
+		return false;
+	}
+	return true;
+}
+
+ItemView Store::Get(std::string_view key) const {
+	return ItemView::Of(image, image.Find(key));
+}
+
+size_t Store::Size() const {
+	return image.Size();
+}
+
+const Image& Store::GetImage() const {
+	return image;
+}
+
+} // namespace config
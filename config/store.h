@@ -0,0 +1,207 @@
+/*
+ * A Store object is a frozen, read-only copy of a loaded config laid out as
+ * parallel arrays (structure-of-arrays) for cache-friendly access. The arrays
+ * live in a single Image, which can also be shared between processes.
+ */
+
+#ifndef CONFIG_STORE_H_
+#define CONFIG_STORE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "handler.h"
+#include "image.h"
+#include "views.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// A lightweight, trivially copyable view of a single item inside an Image,
+// as returned by a Store or a SharedReader. A view is only valid for as long
+// as the image it was obtained from.
+// Typed getters follow the same contract as config::Item and throw
+// std::runtime_error(errors::TYPE_MISMATCH) on a type mismatch.
+class ItemView {
+	public:
+		// Returns false if the view does not point to an item (key not found).
+		bool IsValid() const;
+
+		ValueType GetValueType() const;
+		string GetString() const;
+		bool GetBoolean() const;
+		int64_t GetInteger() const;
+		double GetDouble() const;
+		vector<string> GetList() const;
+		int64_t GetSize() const;
+		std::chrono::nanoseconds GetDuration() const;
+
+		// Allocation-free accessors backed directly by the store's arena.
+		std::string_view GetStringView() const;
+		ListView GetListView() const;
+
+		// Exception-free accessors, defined inline below. These also accept
+		// invalid views, which behave like a type mismatch.
+		std::optional<std::string_view> TryGetString() const noexcept;
+		std::optional<bool> TryGetBoolean() const noexcept;
+		std::optional<int64_t> TryGetInteger() const noexcept;
+		std::optional<double> TryGetDouble() const noexcept;
+		std::optional<ListView> TryGetList() const noexcept;
+		std::optional<int64_t> TryGetSize() const noexcept;
+		std::optional<std::chrono::nanoseconds> TryGetDuration() const noexcept;
+
+		std::string_view GetStringOr(std::string_view) const noexcept;
+		bool GetBooleanOr(bool) const noexcept;
+		int64_t GetIntegerOr(int64_t) const noexcept;
+		double GetDoubleOr(double) const noexcept;
+		int64_t GetSizeOr(int64_t) const noexcept;
+		std::chrono::nanoseconds GetDurationOr(std::chrono::nanoseconds) const noexcept;
+
+		// A view of a slot of an image, or an invalid view if the slot is
+		// Image::NOT_FOUND.
+		static ItemView Of(const Image&, uint32_t);
+
+	private:
+		// True if the view is valid and holds the given type.
+		bool Is(ValueType) const noexcept;
+
+		const Image* image;
+		uint32_t slot;
+};
+
+class Store {
+  private:
+	// The image, in 8-byte words so that its arrays are aligned.
+	vector<uint64_t> buffer;
+	Image image;
+
+  public:
+	Store();
+
+	// The image points into the buffer, so copies attach to their own.
+	Store(const Store&);
+	Store& operator=(const Store&);
+
+	// Freeze every setting currently loaded in a Handler into this store,
+	// replacing any previous contents.
+	void Load(const Handler&);
+
+	// Write the image to a snapshot file, replacing it. Throws if the file
+	// cannot be written.
+	void Save(const string&) const;
+
+	// Replace the contents of this store with a snapshot file written by
+	// Save(). Throws if the file cannot be read, and returns false, leaving
+	// the store empty, if it is not a valid snapshot.
+	bool Open(const string&);
+
+	// Get a view of an individual setting. Returns an invalid view if not found.
+	ItemView Get(std::string_view) const;
+
+	// Number of items in the store.
+	size_t Size() const;
+
+	// The image backing the store.
+	const Image& GetImage() const;
+};
+
+inline bool ItemView::Is(ValueType type) const noexcept {
+	return image != NULL && image->types[slot] == type;
+}
+
+inline std::optional<std::string_view> ItemView::TryGetString() const noexcept {
+	if (!Is(ValueType::STRING)) {
+		return std::nullopt;
+	}
+	const Span& span = image->spans[slot];
+	return std::string_view(image->arena + span.offset, span.length);
+}
+
+inline std::optional<bool> ItemView::TryGetBoolean() const noexcept {
+	if (!Is(ValueType::BOOLEAN)) {
+		return std::nullopt;
+	}
+	return image->scalars[slot] != 0;
+}
+
+inline std::optional<int64_t> ItemView::TryGetInteger() const noexcept {
+	if (!Is(ValueType::INTEGER)) {
+		return std::nullopt;
+	}
+	int64_t out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return out;
+}
+
+inline std::optional<double> ItemView::TryGetDouble() const noexcept {
+	if (!Is(ValueType::DOUBLE)) {
+		return std::nullopt;
+	}
+	double out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return out;
+}
+
+inline std::optional<ListView> ItemView::TryGetList() const noexcept {
+	if (!Is(ValueType::LIST)) {
+		return std::nullopt;
+	}
+	const Span& span = image->spans[slot];
+	return ListView(image->arena, image->listSpans + span.offset, span.length);
+}
+
+inline std::optional<int64_t> ItemView::TryGetSize() const noexcept {
+	if (!Is(ValueType::SIZE)) {
+		return std::nullopt;
+	}
+	int64_t out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return out;
+}
+
+inline std::optional<std::chrono::nanoseconds> ItemView::TryGetDuration() const noexcept {
+	if (!Is(ValueType::DURATION)) {
+		return std::nullopt;
+	}
+	int64_t out;
+	std::memcpy(&out, &image->scalars[slot], sizeof(out));
+	return std::chrono::nanoseconds(out);
+}
+
+inline std::string_view ItemView::GetStringOr(std::string_view fallback) const noexcept {
+	return TryGetString().value_or(fallback);
+}
+
+inline bool ItemView::GetBooleanOr(bool fallback) const noexcept {
+	return TryGetBoolean().value_or(fallback);
+}
+
+inline int64_t ItemView::GetIntegerOr(int64_t fallback) const noexcept {
+	return TryGetInteger().value_or(fallback);
+}
+
+inline double ItemView::GetDoubleOr(double fallback) const noexcept {
+	return TryGetDouble().value_or(fallback);
+}
+
+inline int64_t ItemView::GetSizeOr(int64_t fallback) const noexcept {
+	return TryGetSize().value_or(fallback);
+}
+
+inline std::chrono::nanoseconds ItemView::GetDurationOr(std::chrono::nanoseconds fallback) const noexcept {
+	return TryGetDuration().value_or(fallback);
+}
+
+} // namespace config
+
+#endif // CONFIG_STORE_H_
@@ -0,0 +1,92 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "../common/lest.hpp"
+#include "store.h"
+
+const lest::test specification[] = {
+	CASE("A store holds the same values as the handler it was frozen from") {
+		config::Handler handler;
+		EXPECT(handler.Load("sample.ini", {"production", "ubuntu"}) == true);
+
+		config::Store store;
+		store.Load(handler);
+		EXPECT(store.Size() == 10u);
+
+		config::ItemView view = store.Get("common.paid_users_size_limit");
+		EXPECT(view.IsValid());
+		EXPECT(view.GetValueType() == config::ValueType::INTEGER);
+		EXPECT(view.GetInteger() == 2147483648);
+
+		view = store.Get("ftp.enabled");
+		EXPECT(view.GetValueType() == config::ValueType::BOOLEAN);
+		EXPECT(view.GetBoolean() == false);
+
+		view = store.Get("ftp.name");
+		EXPECT(view.GetValueType() == config::ValueType::STRING);
+		EXPECT(view.GetString() == "hello there, ftp uploading");
+
+		// Overrides are resolved by the handler before freezing
+		view = store.Get("ftp.path");
+		EXPECT(view.GetString() == "/etc/var/uploads");
+
+		std::vector<std::string> listValue = {"array", "of", "values"};
+		view = store.Get("http.params");
+		EXPECT(view.GetValueType() == config::ValueType::LIST);
+		EXPECT(view.GetList() == listValue);
+
+		// Views are served straight from the store's arena
+		config::ListView list = view.GetListView();
+		EXPECT(list.size() == 3u);
+		EXPECT(list[1] == "of");
+		EXPECT(store.Get("ftp.name").GetStringView() == "hello there, ftp uploading");
+
+		// Missing keys yield an invalid view
+		EXPECT(store.Get("ftp.foobar123").IsValid() == false);
+		EXPECT(store.Get("ftp.foobar123").GetIntegerOr(5) == 5);
+		EXPECT(!store.Get("ftp.name").TryGetInteger().has_value());
+	},
+
+	CASE("A store view is restricted to its type") {
+		config::Handler handler;
+		handler.Load("sample.ini", {});
+
+		config::Store store;
+		store.Load(handler);
+
+		config::ItemView view = store.Get("common.basic_size_limit");
+		EXPECT(view.GetInteger() == 26214400);
+		EXPECT_THROWS_AS(view.GetString(), std::runtime_error);
+		EXPECT_THROWS_AS(view.GetBoolean(), std::runtime_error);
+		EXPECT_THROWS_AS(view.GetDouble(), std::runtime_error);
+		EXPECT_THROWS_AS(view.GetList(), std::runtime_error);
+	},
+
+	CASE("A store can be saved to and opened from a snapshot file") {
+		config::Handler handler;
+		handler.Load("sample.ini", {"production"});
+		config::Store store;
+		store.Load(handler);
+
+		std::string filename = (std::filesystem::temp_directory_path() / "config_store_test.snapshot").string();
+		store.Save(filename);
+		config::Store opened;
+		EXPECT(opened.Open(filename) == true);
+		EXPECT(opened.Size() == store.Size());
+		EXPECT(opened.Get("ftp.path").GetString() == "/srv/var/tmp/");
+		EXPECT(opened.Get("http.params").GetList() == store.Get("http.params").GetList());
+
+		// Anything else is rejected
+		std::ofstream(filename, std::ios::trunc) << "[ftp]\npath=/tmp\n";
+		EXPECT(opened.Open(filename) == false);
+		EXPECT(opened.Size() == 0u);
+		std::filesystem::remove(filename);
+		EXPECT_THROWS_AS(opened.Open(filename), std::runtime_error);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
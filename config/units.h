@@ -0,0 +1,116 @@
+/*
+ * Unit suffixes of size and duration values. A value such as 25MiB, 30s or
+ * 500ms is a whole number of units, without a sign or a decimal point, and
+ * is stored as a number of bytes or nanoseconds. Shared by Parser and
+ * EmbeddedConfig, so everything here is constexpr.
+ */
+
+#ifndef CONFIG_UNITS_H_
+#define CONFIG_UNITS_H_
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+#include "item.h"
+
+namespace config {
+
+struct Unit {
+	std::string_view suffix;
+	ValueType type;
+	// Bytes or nanoseconds per unit.
+	int64_t scale;
+};
+
+// Every suffix, by type and then by increasing scale.
+constexpr Unit UNITS[] = {
+	{"B", ValueType::SIZE, 1},
+	{"KB", ValueType::SIZE, 1000},
+	{"KiB", ValueType::SIZE, int64_t(1) << 10},
+	{"MB", ValueType::SIZE, 1000 * 1000},
+	{"MiB", ValueType::SIZE, int64_t(1) << 20},
+	{"GB", ValueType::SIZE, 1000 * 1000 * 1000},
+	{"GiB", ValueType::SIZE, int64_t(1) << 30},
+	{"TB", ValueType::SIZE, int64_t(1000) * 1000 * 1000 * 1000},
+	{"TiB", ValueType::SIZE, int64_t(1) << 40},
+	{"PB", ValueType::SIZE, int64_t(1000) * 1000 * 1000 * 1000 * 1000},
+	{"PiB", ValueType::SIZE, int64_t(1) << 50},
+	{"ns", ValueType::DURATION, 1},
+	{"us", ValueType::DURATION, 1000},
+	{"ms", ValueType::DURATION, 1000 * 1000},
+	{"s", ValueType::DURATION, 1000 * 1000 * 1000},
+	{"m", ValueType::DURATION, int64_t(60) * 1000 * 1000 * 1000},
+	{"h", ValueType::DURATION, int64_t(3600) * 1000 * 1000 * 1000},
+	{"d", ValueType::DURATION, int64_t(86400) * 1000 * 1000 * 1000}
+};
+
+// The outcome of reading a value as a number of units.
+enum class UnitRead {
+	// Not digits followed by a known suffix.
+	NONE,
+	VALUE,
+	// Digits and a known suffix, but more than an int64_t of bytes or
+	// nanoseconds.
+	TOO_LARGE
+};
+
+// Read a value as a number of units. On VALUE, sets the type and the
+// number of bytes or nanoseconds.
+constexpr UnitRead ReadUnitValue(std::string_view in, ValueType& type, int64_t& value) {
+	size_t digits = 0;
+	while (digits < in.size() && in[digits] >= '0' && in[digits] <= '9') {
+		digits++;
+	}
+	// Suffixes are one to three letters, so most values are ruled out here.
+	size_t length = in.size() - digits;
+	if (digits == 0 || length == 0 || length > 3) {
+		return UnitRead::NONE;
+	}
+	std::string_view suffix = in.substr(digits);
+	const Unit* unit = nullptr;
+	for (const Unit& candidate : UNITS) {
+		if (candidate.suffix == suffix) {
+			unit = &candidate;
+			break;
+		}
+	}
+	if (unit == nullptr) {
+		return UnitRead::NONE;
+	}
+
+	int64_t count = 0;
+	for (size_t i = 0; i < digits; i++) {
+		int digit = in[i] - '0';
+		if (count > (std::numeric_limits<int64_t>::max() - digit) / 10) {
+			return UnitRead::TOO_LARGE;
+		}
+		count = count * 10 + digit;
+	}
+	if (count > std::numeric_limits<int64_t>::max() / unit->scale) {
+		return UnitRead::TOO_LARGE;
+	}
+	type = unit->type;
+	value = count * unit->scale;
+	return UnitRead::VALUE;
+}
+
+// The largest unit of a type that a non-negative amount is a whole number
+// of, so that it is written as 25MiB rather than 26214400B. Zero is written
+// in the smallest unit.
+constexpr const Unit& LargestUnit(ValueType type, int64_t value) {
+	const Unit* largest = nullptr;
+	for (const Unit& unit : UNITS) {
+		if (unit.type != type) {
+			continue;
+		}
+		if (largest == nullptr || (value != 0 && value % unit.scale == 0 && unit.scale > largest->scale)) {
+			largest = &unit;
+		}
+	}
+	return *largest;
+}
+
+} // namespace config
+
+#endif // CONFIG_UNITS_H_
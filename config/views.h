@@ -0,0 +1,95 @@
+/*
+ * Non-owning views over config values that are stored back to back in a
+ * character arena or a typed array. Views never allocate or copy, and are
+ * only valid for as long as the object that owns the storage.
+ */
+
+#ifndef CONFIG_VIEWS_H_
+#define CONFIG_VIEWS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace config {
+
+// An offset and length into an arena. Offsets are relative to the start of
+// the arena so that spans stay valid when the arena is copied or mapped at
+// a different address.
+struct Span {
+	uint32_t offset;
+	uint32_t length;
+};
+
+// A read-only view of a list of strings, described by an array of spans
+// into a shared arena.
+class ListView {
+	public:
+		class Iterator {
+			public:
+				constexpr Iterator(const char* arena, const Span* span) : arena(arena), span(span) {}
+
+				constexpr std::string_view operator*() const {
+					return std::string_view(arena + span->offset, span->length);
+				}
+				constexpr Iterator& operator++() {
+					++span;
+					return *this;
+				}
+				constexpr bool operator==(const Iterator& other) const {
+					return span == other.span;
+				}
+				constexpr bool operator!=(const Iterator& other) const {
+					return span != other.span;
+				}
+
+			private:
+				const char* arena;
+				const Span* span;
+		};
+
+		constexpr ListView() : arena(NULL), spans(NULL), count(0) {}
+		constexpr ListView(const char* arena, const Span* spans, size_t count)
+			: arena(arena), spans(spans), count(count) {}
+
+		constexpr size_t size() const { return count; }
+		constexpr bool empty() const { return count == 0; }
+
+		constexpr std::string_view operator[](size_t i) const {
+			return std::string_view(arena + spans[i].offset, spans[i].length);
+		}
+
+		constexpr Iterator begin() const { return Iterator(arena, spans); }
+		constexpr Iterator end() const { return Iterator(arena, spans + count); }
+
+	private:
+		const char* arena;
+		const Span* spans;
+		size_t count;
+};
+
+// A read-only view of a contiguous array of values, like std::span in
+// C++20.
+template <typename T>
+class ArrayView {
+	public:
+		constexpr ArrayView() : items(NULL), count(0) {}
+		constexpr ArrayView(const T* items, size_t count) : items(items), count(count) {}
+
+		constexpr size_t size() const { return count; }
+		constexpr bool empty() const { return count == 0; }
+		constexpr const T* data() const { return items; }
+
+		constexpr const T& operator[](size_t i) const { return items[i]; }
+
+		constexpr const T* begin() const { return items; }
+		constexpr const T* end() const { return items + count; }
+
+	private:
+		const T* items;
+		size_t count;
+};
+
+} // namespace config
+
+#endif // CONFIG_VIEWS_H_
@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <tuple>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "errors.h"
+#include "watcher.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+ConfigWatcher::ConfigWatcher(const string& filename, const vector<string>& overrides,
+	std::chrono::milliseconds debounce)
+	: filename(filename),
+	  overrides(overrides),
+	  debounce(debounce),
+	  current(std::make_shared<Handler>()),
+	  missedReload(false),
+	  stopping(false),
+	  reloads(0),
+	  inotifyFd(-1),
+	  watchFd(-1),
+	  wakeFd(-1),
+	  lastSubscription(0),
+	  subscriptionCount(0),
+	  dispatching(false) {
+	std::filesystem::path path(filename);
+	directory = path.has_parent_path() ? path.parent_path().string() : ".";
+	basename = path.filename().string();
+}
+
+ConfigWatcher::~ConfigWatcher() {
+	Stop();
+}
+
+void ConfigWatcher::OnReload(std::function<void(const std::shared_ptr<const Handler>&)> callback) {
+	listener = callback;
+}
+
+void ConfigWatcher::SetSchema(std::shared_ptr<const Schema> schema) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	current->SetSchema(std::move(schema));
+}
+
+void ConfigWatcher::Start() {
+#if defined(__linux__)
+	ResolveLink();
+
+	// Watch before the first load, so that no change can slip in between.
+	// If any step fails, fall back to polling.
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd >= 0) {
+		watchFd = inotify_add_watch(inotifyFd, directory.c_str(),
+			IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_MOVED_TO);
+		wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (watchFd < 0 || wakeFd < 0) {
+			close(inotifyFd);
+			inotifyFd = -1;
+			if (wakeFd >= 0) {
+				close(wakeFd);
+				wakeFd = -1;
+			}
+		}
+	}
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		if (current->Reload(filename, overrides, reloadContext) == INVALID) {
+			throw std::runtime_error(errors::WATCHER_INVALID);
+		}
+		checked = current->GetFingerprint();
+		std::atomic_store(&snapshot, std::shared_ptr<const Handler>(current));
+		reloads = 1;
+	}
+
+	dispatching = true;
+	dispatcher = std::thread(&ConfigWatcher::Dispatch, this);
+	stopping = false;
+	thread = std::thread(&ConfigWatcher::Run, this);
+}
+
+void ConfigWatcher::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+#if defined(__linux__)
+	if (wakeFd >= 0) {
+		uint64_t one = 1;
+		ssize_t written = write(wakeFd, &one, sizeof(one));
+		(void)written;
+	}
+#endif
+	if (thread.joinable()) {
+		thread.join();
+	}
+
+	// The watcher thread queues no more batches now; deliver those that are
+	// still queued, then stop dispatching.
+	{
+		std::lock_guard<std::mutex> lock(batchMutex);
+		dispatching = false;
+	}
+	batchReady.notify_all();
+	if (dispatcher.joinable()) {
+		dispatcher.join();
+	}
+#if defined(__linux__)
+	if (inotifyFd >= 0) {
+		close(inotifyFd);
+		inotifyFd = -1;
+		watchFd = -1;
+	}
+	if (wakeFd >= 0) {
+		close(wakeFd);
+		wakeFd = -1;
+	}
+#endif
+}
+
+std::shared_ptr<const Handler> ConfigWatcher::Snapshot() const {
+	return std::atomic_load(&snapshot);
+}
+
+uint64_t ConfigWatcher::Reloads() const {
+	return reloads;
+}
+
+void ConfigWatcher::Run() {
+	while (WaitForChange()) {
+		ReloadNow();
+	}
+}
+
+bool ConfigWatcher::WaitForChange() {
+	if (inotifyFd < 0) {
+		// Polling is cheap, since Reload only stats an unchanged file.
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait_for(lock, POLL_INTERVAL, [this] { return stopping.load(); });
+		return !stopping;
+	}
+
+#if defined(__linux__)
+	pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+
+	// Wait for the first event about the file.
+	while (true) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (fds[1].revents != 0) {
+			return false;
+		}
+		if (DrainEvents()) {
+			break;
+		}
+	}
+
+	// Then wait until the file has been quiet for the debounce period.
+	auto deadline = std::chrono::steady_clock::now() + debounce;
+	while (true) {
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+			deadline - std::chrono::steady_clock::now());
+		if (remaining.count() <= 0) {
+			return true;
+		}
+		int ready = poll(fds, 2, static_cast<int>(remaining.count()));
+		if (ready < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (ready == 0) {
+			return true;
+		}
+		if (fds[1].revents != 0) {
+			return false;
+		}
+		if (DrainEvents()) {
+			deadline = std::chrono::steady_clock::now() + debounce;
+		}
+	}
+#else
+	return false;
+#endif
+}
+
+bool ConfigWatcher::DrainEvents() {
+	bool relevant = false;
+#if defined(__linux__)
+	bool relinked = false;
+	alignas(inotify_event) char buffer[4096];
+	while (true) {
+		ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			break;
+		}
+		for (char* p = buffer; p < buffer + length; ) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+			// Events for other files in the directory are ignored. If the
+			// queue overflowed, events were lost, so assume the worst.
+			if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && basename == event->name)) {
+				relevant = true;
+				relinked = true;
+			} else if (event->len > 0 && !linkName.empty() && linkName == event->name) {
+				relevant = true;
+			}
+			p += sizeof(inotify_event) + event->len;
+		}
+	}
+	// The file itself changed, so it may now link somewhere else.
+	if (relinked) {
+		ResolveLink();
+	}
+#endif
+	return relevant;
+}
+
+void ConfigWatcher::ResolveLink() {
+	linkName.clear();
+	std::error_code ec;
+	std::filesystem::path target = std::filesystem::read_symlink(filename, ec);
+	if (ec || target.is_absolute() || target.empty()) {
+		return;
+	}
+	// "..data/app.ini" goes through "..data", and a plain "app.v2.ini" is
+	// its own entry. "." and ".." leave the directory.
+	string first = target.begin()->string();
+	if (first != "." && first != "..") {
+		linkName = first;
+	}
+}
+
+void ConfigWatcher::ReloadNow() {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	// The file may be briefly missing while it is being replaced. Keep the
+	// current snapshot; the replacement will trigger another event. A file
+	// that was not written to, e.g. when polling, is not worth taking the
+	// spare for.
+	Fingerprint stat;
+	if (!StatFile(filename, stat) || stat.SameStat(checked)) {
+		return;
+	}
+	Handler& next = Spare();
+	try {
+		ReloadStatus status = next.Reload(filename, overrides, reloadContext);
+		// Reading the same invalid file again would not make it valid.
+		checked = stat;
+		if (status != RELOADED) {
+			return;
+		}
+	} catch (const std::exception&) {
+		// Nothing is replaced unless the whole file is valid, but a critical
+		// error is rare enough to not trust the spare after it.
+		spare.reset();
+		return;
+	}
+	Publish();
+	missedReload = true;
+}
+
+void ConfigWatcher::Set(const string& key, const config::Item& value) {
+	Transaction(*this).Set(key, value).Commit();
+}
+
+void ConfigWatcher::Commit(const vector<std::pair<string, config::Item>>& changes) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	// The changes are applied to the spare, which nobody reads, so that one
+	// that throws, e.g. because a value that refers to it no longer parses,
+	// leaves the snapshot as it was. A single Set changes nothing if it
+	// throws; after several, the spare is dropped rather than undone.
+	Handler& next = Spare();
+	try {
+		for (const auto& change : changes) {
+			next.Set(change.first, change.second);
+		}
+	} catch (const std::exception&) {
+		if (changes.size() > 1) {
+			spare.reset();
+		}
+		throw;
+	}
+	Publish();
+	missedChanges = changes;
+}
+
+Handler& ConfigWatcher::Spare() {
+	// Readers may still be reading the previous snapshot. Those that let go
+	// of it did so before the count dropped, and the fence orders the writes
+	// below after their reads. The count cannot rise again, since the spare
+	// is not published.
+	if (spare && spare.use_count() == 1) {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (missedReload) {
+			spare->Replay(*current, reloadContext);
+		}
+		for (const auto& change : missedChanges) {
+			spare->Set(change.first, change.second);
+		}
+	} else {
+		spare = std::make_shared<Handler>(*current);
+	}
+	missedReload = false;
+	missedChanges.clear();
+	return *spare;
+}
+
+void ConfigWatcher::Publish() {
+	// Readers holding the previous snapshot keep it alive, unchanged, until
+	// they drop it; only then does it take changes as the spare.
+	std::shared_ptr<Handler> previous = std::move(current);
+	current = std::move(spare);
+	spare = previous;
+	// Values derived from the previous snapshot carry over to the next one
+	// where their dependencies did not change.
+	current->AdoptDerived(*previous);
+	std::shared_ptr<const Handler> next = current;
+	std::atomic_store(&snapshot, next);
+	reloads++;
+	if (listener) {
+		listener(next);
+	}
+
+	// Diffing costs about as much as the change, and is skipped entirely
+	// while nobody is subscribed.
+	if (subscriptionCount > 0) {
+		Batch batch;
+		batch.diff = Diff(*previous, *next);
+		batch.snapshot = next;
+		if (!batch.diff.Empty()) {
+			{
+				std::lock_guard<std::mutex> lock(batchMutex);
+				batches.push_back(std::move(batch));
+			}
+			batchReady.notify_one();
+		}
+	}
+}
+
+uint64_t ConfigWatcher::Subscribe(const string& key, KeyCallback callback) {
+	string::size_type pos = key.find(SECTION_DELIM);
+	if (pos == string::npos) {
+		throw std::runtime_error(errors::SUBSCRIPTION_KEY);
+	}
+	std::lock_guard<std::mutex> lock(subscriptionMutex);
+	uint64_t sectionId = subscriptionNames.Intern(std::string_view(key).substr(0, pos));
+	uint64_t keyId = subscriptionNames.Intern(std::string_view(key).substr(pos + 1));
+	Subscription<KeyCallback> subscription;
+	subscription.id = ++lastSubscription;
+	subscription.callback = callback;
+	keySubscriptions[(sectionId << 32) | keyId].push_back(subscription);
+	subscriptionCount++;
+	return subscription.id;
+}
+
+uint64_t ConfigWatcher::SubscribeSection(const string& section, SectionCallback callback) {
+	std::lock_guard<std::mutex> lock(subscriptionMutex);
+	Subscription<SectionCallback> subscription;
+	subscription.id = ++lastSubscription;
+	subscription.callback = callback;
+	sectionSubscriptions[subscriptionNames.Intern(section)].push_back(subscription);
+	subscriptionCount++;
+	return subscription.id;
+}
+
+void ConfigWatcher::Unsubscribe(uint64_t id) {
+	std::lock_guard<std::mutex> lock(subscriptionMutex);
+	auto erase = [this, id](auto& subscriptions) {
+		for (auto it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+			auto& list = it->second;
+			for (auto sub = list.begin(); sub != list.end(); ++sub) {
+				if (sub->id == id) {
+					list.erase(sub);
+					if (list.empty()) {
+						subscriptions.erase(it);
+					}
+					subscriptionCount--;
+					return true;
+				}
+			}
+		}
+		return false;
+	};
+	if (!erase(keySubscriptions)) {
+		erase(sectionSubscriptions);
+	}
+}
+
+void ConfigWatcher::Dispatch() {
+	std::unique_lock<std::mutex> lock(batchMutex);
+	while (true) {
+		batchReady.wait(lock, [this] { return !batches.empty() || !dispatching; });
+		if (batches.empty()) {
+			return;
+		}
+		Batch batch = std::move(batches.front());
+		batches.pop_front();
+		lock.unlock();
+		Notify(batch);
+		lock.lock();
+	}
+}
+
+void ConfigWatcher::Notify(const Batch& batch) {
+	// Look up the callbacks under the lock, but run them after releasing it,
+	// so that they can subscribe and unsubscribe.
+	vector<std::pair<const string*, KeyCallback>> keyCalls;
+	vector<std::tuple<string, vector<string>, SectionCallback>> sectionCalls;
+	{
+		std::lock_guard<std::mutex> lock(subscriptionMutex);
+		unordered_map<uint32_t, vector<string>> sectionKeys;
+		for (const vector<string>* names : {&batch.diff.added, &batch.diff.removed, &batch.diff.changed}) {
+			for (const string& name : *names) {
+				// Names that were never subscribed to are not interned, so
+				// most changes stop at the first lookup.
+				string::size_type pos = name.find(SECTION_DELIM);
+				uint32_t sectionId = subscriptionNames.Find(std::string_view(name).substr(0, pos));
+				if (sectionId == Interner::NOT_FOUND) {
+					continue;
+				}
+				if (sectionSubscriptions.count(sectionId) > 0) {
+					sectionKeys[sectionId].push_back(name);
+				}
+				uint32_t keyId = subscriptionNames.Find(std::string_view(name).substr(pos + 1));
+				if (keyId == Interner::NOT_FOUND) {
+					continue;
+				}
+				auto it = keySubscriptions.find((static_cast<uint64_t>(sectionId) << 32) | keyId);
+				if (it == keySubscriptions.end()) {
+					continue;
+				}
+				for (const auto& subscription : it->second) {
+					keyCalls.emplace_back(&name, subscription.callback);
+				}
+			}
+		}
+		for (auto& kv : sectionKeys) {
+			std::sort(kv.second.begin(), kv.second.end());
+			string section(subscriptionNames.Name(kv.first));
+			for (const auto& subscription : sectionSubscriptions[kv.first]) {
+				sectionCalls.emplace_back(section, kv.second, subscription.callback);
+			}
+		}
+	}
+
+	for (const auto& call : keyCalls) {
+		call.second(*call.first, batch.snapshot);
+	}
+	for (const auto& call : sectionCalls) {
+		std::get<2>(call)(std::get<0>(call), std::get<1>(call), batch.snapshot);
+	}
+}
+
+Transaction::Transaction(ConfigWatcher& watcher) : watcher(watcher) {}
+
+Transaction& Transaction::Set(const string& key, const config::Item& value) {
+	// Check names here, so that a bad name is reported where it was set.
+	if (key.find(SECTION_DELIM) == string::npos) {
+		throw std::runtime_error(errors::SETTING_KEY);
+	}
+	changes.emplace_back(key, value);
+	return *this;
+}
+
+Transaction& Transaction::Set(const string& key, std::string_view value) {
+	return Set(key, parser.ConstructValueObject(value));
+}
+
+void Transaction::Commit() {
+	watcher.Commit(changes);
+	changes.clear();
+}
+
+} // namespace config
@@ -0,0 +1,270 @@
+/*
+ * A ConfigWatcher object keeps a config file loaded, reloading it in the
+ * background whenever it changes on disk, and publishes each new version as
+ * an immutable snapshot.
+ */
+
+#ifndef CONFIG_WATCHER_H_
+#define CONFIG_WATCHER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "diff.h"
+#include "fingerprint.h"
+#include "handler.h"
+#include "interner.h"
+#include "load_context.h"
+
+namespace config {
+
+// For readability
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// Called with a changed "section.key" name and the snapshot it changed in.
+using KeyCallback = std::function<void(const string&, const std::shared_ptr<const Handler>&)>;
+
+// Called with a section name, the sorted "section.key" names that changed in
+// it, and the snapshot they changed in.
+using SectionCallback = std::function<void(const string&, const vector<string>&, const std::shared_ptr<const Handler>&)>;
+
+class Transaction;
+
+class ConfigWatcher {
+  private:
+	friend class Transaction;
+
+	const string filename;
+	const vector<string> overrides;
+
+	// The directory holding the file, and the file's name within it.
+	string directory;
+	string basename;
+
+	// If the file is a symlink into its own directory, the directory entry
+	// it points through. A Kubernetes ConfigMap volume links "app.ini" to
+	// "..data/app.ini" and updates by renaming a new "..data" into place,
+	// without touching "app.ini". Empty if the file is not such a symlink.
+	// Only used by the watcher thread once started.
+	string linkName;
+
+	// Quiet period after the last file event before reloading, so that a
+	// burst of writes (or a write followed by a rename) causes one reload.
+	const std::chrono::milliseconds debounce;
+
+	// Reloads and runtime commits are applied, one at a time under
+	// writerMutex, to a spare handler, which is then published itself as the
+	// new snapshot, and the handler it replaces becomes the spare. Once
+	// readers have let go of that one, the change it missed is replayed on
+	// it, so that a change costs about what applying it costs. The settings
+	// are only copied while readers still hold the previous snapshot.
+	std::shared_ptr<Handler> current;
+	std::shared_ptr<Handler> spare;
+	std::mutex writerMutex;
+
+	// The change the spare missed, i.e. the last one published: a reload,
+	// whose file is still in reloadContext, or runtime changes.
+	bool missedReload;
+	vector<std::pair<string, config::Item>> missedChanges;
+
+	// Scratch state of reloads, which also keeps the file of the last one
+	// for the spare to replay.
+	LoadContext reloadContext;
+
+	// The stat metadata of the file as last read, whether or not it was
+	// published or valid, so that checking a file that was not written to
+	// since is free.
+	Fingerprint checked;
+
+	// The latest successfully loaded settings. Read and replaced atomically.
+	std::shared_ptr<const Handler> snapshot;
+
+	// Called after each new snapshot is published.
+	std::function<void(const std::shared_ptr<const Handler>&)> listener;
+
+	std::atomic<bool> stopping;
+	std::atomic<uint64_t> reloads;
+	std::thread thread;
+
+	// inotify descriptor and watch on the file's directory, and a descriptor
+	// written to by Stop() to wake the thread. -1 when polling instead.
+	int inotifyFd;
+	int watchFd;
+	int wakeFd;
+
+	// Used to wake the thread when polling.
+	std::mutex mutex;
+	std::condition_variable wake;
+
+	template <typename Callback>
+	struct Subscription {
+		uint64_t id;
+		Callback callback;
+	};
+
+	// Subscriptions, indexed by the IDs of their names interned in
+	// subscriptionNames: keys by packed (section ID, key ID), sections by
+	// section ID. Snapshots each intern names on their own, so the watcher
+	// keeps a separate interner that outlives them.
+	std::mutex subscriptionMutex;
+	Interner subscriptionNames;
+	unordered_map<uint64_t, vector<Subscription<KeyCallback>>> keySubscriptions;
+	unordered_map<uint32_t, vector<Subscription<SectionCallback>>> sectionSubscriptions;
+	uint64_t lastSubscription;
+	std::atomic<size_t> subscriptionCount;
+
+	// The changes of each reload, queued by the watcher thread for the
+	// dispatcher thread, which runs the subscription callbacks.
+	struct Batch {
+		ConfigDiff diff;
+		std::shared_ptr<const Handler> snapshot;
+	};
+	std::mutex batchMutex;
+	std::condition_variable batchReady;
+	std::deque<Batch> batches;
+	bool dispatching;
+	std::thread dispatcher;
+
+	// The dispatcher thread's main loop.
+	void Dispatch();
+
+	// Run the callbacks subscribed to the changes of one reload.
+	void Notify(const Batch&);
+
+	// The watcher thread's main loop.
+	void Run();
+
+	// Block until the file may have changed. Returns false when stopping.
+	bool WaitForChange();
+
+	// Read pending inotify events. Returns true if any concerns the file.
+	bool DrainEvents();
+
+	// Set linkName from the file's symlink target.
+	void ResolveLink();
+
+	// Reload the file and publish a new snapshot if it changed.
+	void ReloadNow();
+
+	// Apply runtime changes and publish them as one new snapshot. If one of
+	// them throws, none of them are applied.
+	void Commit(const vector<std::pair<string, config::Item>>&);
+
+	// The spare, with the change it missed applied: the previous snapshot if
+	// no reader holds it any more, or else a new copy of the current one.
+	// Must be called with writerMutex held.
+	Handler& Spare();
+
+	// Publish the spare as the new snapshot, and queue its changes for
+	// subscribers. Must be called with writerMutex held.
+	void Publish();
+
+  public:
+	// How often the file is checked when inotify is not available.
+	static constexpr std::chrono::milliseconds POLL_INTERVAL{1000};
+
+	ConfigWatcher(const string&, const vector<string>&,
+		std::chrono::milliseconds debounce = std::chrono::milliseconds(50));
+
+	// Stops the watcher thread.
+	~ConfigWatcher();
+
+	ConfigWatcher(const ConfigWatcher&) = delete;
+	ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+	// Set a function to call with each new snapshot. Must be called before
+	// Start(). It runs on the thread that published the snapshot (the watcher
+	// thread, or one committing runtime changes), so it should return quickly.
+	// Subscription callbacks, below, run on a separate dispatcher thread
+	// instead, and may take their time.
+	void OnReload(std::function<void(const std::shared_ptr<const Handler>&)>);
+
+	// Check every load against a schema. Must be called before Start(). A
+	// reload that breaks a rule is not published, like any invalid file.
+	void SetSchema(std::shared_ptr<const Schema>);
+
+	// Call a function whenever a "section.key" setting is added, removed or
+	// changed by a reload. Returns an ID for Unsubscribe(). Throws if the name
+	// has no section delimiter.
+	uint64_t Subscribe(const string&, KeyCallback);
+
+	// Call a function once per reload that adds, removes or changes any
+	// setting in a section. Returns an ID for Unsubscribe().
+	uint64_t SubscribeSection(const string&, SectionCallback);
+
+	// Remove a subscription. Its callback may still run once if a batch is
+	// being dispatched concurrently.
+	void Unsubscribe(uint64_t);
+
+	// Load the file, publish the first snapshot and start watching. Throws if
+	// the file cannot be opened or contains an invalid setting.
+	// The directory of the file is watched, rather than the file itself, so
+	// that editors and deploy tools that replace the file by renaming a new
+	// one over it are picked up too. So are swaps of a symlink the file
+	// points through in the same directory, as in a ConfigMap volume. Links
+	// through other directories are only picked up when polling.
+	void Start();
+
+	// Stop watching and join the watcher thread. Safe to call more than once.
+	void Stop();
+
+	// The latest snapshot. It stays valid, and unchanged, for as long as the
+	// caller holds it, even if newer snapshots are published meanwhile.
+	std::shared_ptr<const Handler> Snapshot() const;
+
+	// Set a single setting at runtime, and publish it as a new snapshot.
+	// Use a Transaction to publish several changes at once. Must be called
+	// after Start(). Changes last until the file changes on disk.
+	void Set(const string&, const config::Item&);
+
+	// Number of snapshots published since Start(), including the first and
+	// those published by runtime changes.
+	uint64_t Reloads() const;
+};
+
+// A batch of runtime changes to the settings of a ConfigWatcher, published
+// together as one new snapshot, so that readers see all of them or none:
+//
+//   config::Transaction(watcher).Set("ftp.path", "/srv").Set("ftp.enabled", "yes").Commit();
+//
+// Commits are serialized with each other and with reloads. Readers never
+// wait for them: each commit applies the changes to a spare copy of the
+// settings, and swaps it in as the new snapshot.
+class Transaction {
+  private:
+	ConfigWatcher& watcher;
+	vector<std::pair<string, config::Item>> changes;
+	config::Parser parser;
+
+  public:
+	explicit Transaction(ConfigWatcher&);
+
+	// Stage a "section.key" setting. Throws if the name has no section delimiter.
+	Transaction& Set(const string&, const config::Item&);
+
+	// Stage a setting from its text, as it would appear after the equals sign
+	// in a config file, e.g. "25", "yes", "\"some text\"" or "a,b,c". Throws if
+	// the value is out of range, like a load would.
+	Transaction& Set(const string&, std::string_view);
+
+	// Publish every staged change as one new snapshot, and clear them.
+	// Throws, and publishes none of them, if one cannot be applied, e.g.
+	// because a value that refers to a changed setting no longer parses.
+	void Commit();
+};
+
+} // namespace config
+
+#endif // CONFIG_WATCHER_H_
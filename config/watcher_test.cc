@@ -0,0 +1,355 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "../common/lest.hpp"
+#include "watcher.h"
+
+// Replace the contents of a file in place.
+void WriteFile(const std::string& filename, const std::string& contents) {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	file << contents;
+}
+
+// Replace a file the way editors and deploy tools do: write a temporary
+// file next to it, then rename it over the original.
+void ReplaceFile(const std::string& filename, const std::string& contents) {
+	std::string temporary = filename + ".tmp";
+	WriteFile(temporary, contents);
+	std::filesystem::rename(temporary, filename);
+}
+
+// Wait until the watched path has the expected value, or give up.
+bool WaitForPath(const config::ConfigWatcher& watcher, const std::string& expected) {
+	for (int i = 0; i < 200; i++) {
+		if (watcher.Snapshot()->GetString("ftp.path", "") == expected) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+constexpr config::Key<std::string_view> kFtpPath("ftp.path");
+
+std::string TemporaryFile(const std::string& name) {
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+const lest::test specification[] = {
+	CASE("A watcher publishes a snapshot for each change") {
+		std::string filename = TemporaryFile("config_watcher_test.ini");
+		WriteFile(filename, "[ftp]\npath=/a\n");
+
+		config::ConfigWatcher watcher(filename, {}, std::chrono::milliseconds(20));
+		watcher.Start();
+		std::shared_ptr<const config::Handler> first = watcher.Snapshot();
+		EXPECT(first->GetString("ftp.path", "") == "/a");
+		EXPECT(watcher.Reloads() == 1u);
+
+		// In-place writes
+		WriteFile(filename, "[ftp]\npath=/b\n");
+		EXPECT(WaitForPath(watcher, "/b") == true);
+
+		// Atomic renames
+		ReplaceFile(filename, "[ftp]\npath=/c\n");
+		EXPECT(WaitForPath(watcher, "/c") == true);
+
+		// Snapshots that are still held do not change
+		EXPECT(first->GetString("ftp.path", "") == "/a");
+
+		// Invalid files keep the last good snapshot
+		ReplaceFile(filename, "[ftp]\nbad\n");
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		EXPECT(watcher.Snapshot()->GetString("ftp.path", "") == "/c");
+
+		watcher.Stop();
+		std::filesystem::remove(filename);
+	},
+
+	CASE("A burst of writes is debounced into one reload") {
+		std::string filename = TemporaryFile("config_watcher_burst_test.ini");
+		WriteFile(filename, "[ftp]\npath=/0\n");
+
+		config::ConfigWatcher watcher(filename, {}, std::chrono::milliseconds(100));
+		int notified = 0;
+		watcher.OnReload([&notified](const std::shared_ptr<const config::Handler>&) {
+			notified++;
+		});
+		watcher.Start();
+
+		for (int i = 1; i <= 10; i++) {
+			ReplaceFile(filename, "[ftp]\npath=/" + std::to_string(i) + "\n");
+		}
+		EXPECT(WaitForPath(watcher, "/10") == true);
+		watcher.Stop();
+
+		EXPECT(watcher.Reloads() == 2u);
+		EXPECT(notified == 1);
+		std::filesystem::remove(filename);
+	},
+
+	CASE("Subscriptions fire once per reload for changed settings") {
+		std::string filename = TemporaryFile("config_watcher_subscribe_test.ini");
+		WriteFile(filename, "[ftp]\npath=/a\nmode=1\n[http]\nport=80\nhost=\"a\"\n[smtp]\nport=25\n");
+
+		config::ConfigWatcher watcher(filename, {}, std::chrono::milliseconds(20));
+		std::mutex mutex;
+		std::vector<std::string> keys;
+		std::vector<std::vector<std::string>> sections;
+		std::thread::id reloadThread;
+		std::thread::id dispatchThread;
+		watcher.OnReload([&](const std::shared_ptr<const config::Handler>&) {
+			std::lock_guard<std::mutex> lock(mutex);
+			reloadThread = std::this_thread::get_id();
+		});
+		uint64_t path = watcher.Subscribe("ftp.path", [&](const std::string& key, const std::shared_ptr<const config::Handler>& snapshot) {
+			std::lock_guard<std::mutex> lock(mutex);
+			keys.push_back(key + "=" + std::string(snapshot->GetString(key, "")));
+			dispatchThread = std::this_thread::get_id();
+		});
+		watcher.Subscribe("ftp.missing", [&](const std::string& key, const std::shared_ptr<const config::Handler>&) {
+			std::lock_guard<std::mutex> lock(mutex);
+			keys.push_back(key);
+		});
+		watcher.SubscribeSection("http", [&](const std::string& section, const std::vector<std::string>& changed, const std::shared_ptr<const config::Handler>&) {
+			std::lock_guard<std::mutex> lock(mutex);
+			sections.push_back(changed);
+		});
+		EXPECT_THROWS_AS(watcher.Subscribe("ftp", nullptr), std::runtime_error);
+		watcher.Start();
+
+		// Only the subscribed key and section fire
+		ReplaceFile(filename, "[ftp]\npath=/b\nmode=2\n[http]\nport=81\nhost=\"b\"\n[smtp]\nport=26\n");
+		EXPECT(WaitForPath(watcher, "/b") == true);
+
+		// Changes elsewhere do not
+		ReplaceFile(filename, "[ftp]\npath=/b\nmode=3\n[http]\nport=81\nhost=\"b\"\n[smtp]\nport=27\n");
+		for (int i = 0; i < 200 && watcher.Snapshot()->GetInteger("ftp.mode", 0) != 3; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		// Unsubscribed callbacks stop firing
+		watcher.Unsubscribe(path);
+		ReplaceFile(filename, "[ftp]\npath=/c\n[http]\nport=81\n");
+		EXPECT(WaitForPath(watcher, "/c") == true);
+		watcher.Stop();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		EXPECT(keys == (std::vector<std::string>{"ftp.path=/b"}));
+		EXPECT(sections.size() == 2u);
+		EXPECT(sections[0] == (std::vector<std::string>{"http.host", "http.port"}));
+		EXPECT(sections[1] == (std::vector<std::string>{"http.host"}));
+		EXPECT(dispatchThread != reloadThread);
+		std::filesystem::remove(filename);
+	},
+
+	CASE("Transactions publish runtime changes atomically") {
+		std::string filename = TemporaryFile("config_watcher_transaction_test.ini");
+		WriteFile(filename, "[ftp]\npath=/a\n[limits]\nlow=0\nhigh=0\n");
+
+		config::ConfigWatcher watcher(filename, {}, std::chrono::milliseconds(20));
+		std::mutex mutex;
+		std::vector<std::string> changed;
+		watcher.SubscribeSection("limits", [&](const std::string&, const std::vector<std::string>& keys, const std::shared_ptr<const config::Handler>&) {
+			std::lock_guard<std::mutex> lock(mutex);
+			changed.insert(changed.end(), keys.begin(), keys.end());
+		});
+		watcher.Start();
+
+		config::Item item;
+		item.SetString("/b");
+		watcher.Set("ftp.path", item);
+		EXPECT(watcher.Snapshot()->GetString("ftp.path", "") == "/b");
+		EXPECT(watcher.Snapshot()->Get(kFtpPath) == "/b");
+		EXPECT_THROWS_AS(watcher.Set("ftp", item), std::runtime_error);
+		EXPECT_THROWS_AS(config::Transaction(watcher).Set("limits.low", "99999999999999999999"), std::runtime_error);
+
+		// Readers never see half of a transaction
+		std::atomic<bool> done(false);
+		std::atomic<int> torn(0);
+		std::thread reader([&]() {
+			while (!done) {
+				std::shared_ptr<const config::Handler> settings = watcher.Snapshot();
+				if (settings->GetInteger("limits.low", -1) != settings->GetInteger("limits.high", -2)) {
+					torn++;
+				}
+			}
+		});
+		for (int i = 1; i <= 1000; i++) {
+			std::string value = std::to_string(i);
+			config::Transaction(watcher).Set("limits.low", value).Set("limits.high", value).Commit();
+		}
+		done = true;
+		reader.join();
+		EXPECT(torn == 0);
+		EXPECT(watcher.Snapshot()->GetInteger("limits.high", 0) == 1000);
+		EXPECT(watcher.Reloads() == 1002u);
+
+		// Each one is applied to the snapshot before last, once readers let
+		// go of it, rather than to a copy of the current one
+		const config::Handler* previous = watcher.Snapshot().get();
+		config::Transaction(watcher).Set("limits.low", "1000").Set("limits.high", "1000").Commit();
+		config::Transaction(watcher).Set("limits.low", "1000").Set("limits.high", "1000").Commit();
+		EXPECT(watcher.Snapshot().get() == previous);
+
+		// Runtime changes last until the file changes
+		ReplaceFile(filename, "[ftp]\npath=/c\n[limits]\nlow=0\nhigh=0\n");
+		EXPECT(WaitForPath(watcher, "/c") == true);
+		EXPECT(watcher.Snapshot()->GetInteger("limits.high", -1) == 0);
+		watcher.Stop();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		EXPECT(changed.size() == 2002u);
+		std::filesystem::remove(filename);
+	},
+
+	CASE("A transaction that fails half way publishes none of its changes") {
+		std::string filename = TemporaryFile("config_watcher_failed_transaction_test.ini");
+		WriteFile(filename, "[ftp]\npath=/a\n[limits]\nbase=1\nscaled=${limits.base}0\n");
+
+		config::ConfigWatcher watcher(filename, {}, std::chrono::milliseconds(20));
+		watcher.Start();
+		uint64_t reloads = watcher.Reloads();
+
+		// The second change makes limits.scaled too large to parse
+		config::Item path;
+		path.SetString("/b");
+		config::Item base;
+		base.SetString("99999999999999999999");
+		EXPECT_THROWS_AS(config::Transaction(watcher).Set("ftp.path", path).Set("limits.base", base).Commit(),
+			std::runtime_error);
+		EXPECT(watcher.Reloads() == reloads);
+		EXPECT(watcher.Snapshot()->GetString("ftp.path", "") == "/a");
+
+		// Nor do they leak into the next commit
+		config::Transaction(watcher).Set("limits.base", "2").Commit();
+		EXPECT(watcher.Snapshot()->GetString("ftp.path", "") == "/a");
+		EXPECT(watcher.Snapshot()->GetInteger("limits.scaled", 0) == 20);
+		watcher.Stop();
+		std::filesystem::remove(filename);
+	},
+
+	CASE("Changes are published without copying the settings while no reader holds the old ones") {
+		std::string filename = TemporaryFile("config_watcher_spare_test.ini");
+		WriteFile(filename, "[ftp]\npath=/a\n[limits]\nlow=1\n");
+
+		config::ConfigWatcher watcher(filename, {}, std::chrono::milliseconds(20));
+		watcher.Start();
+		const config::Handler* first = watcher.Snapshot().get();
+
+		// The first change needs a copy to apply to
+		config::Item item;
+		item.SetString("/b");
+		watcher.Set("ftp.path", item);
+		const config::Handler* second = watcher.Snapshot().get();
+		EXPECT(second != first);
+
+		// Later ones catch up the previous snapshot and publish it again
+		config::Transaction(watcher).Set("limits.low", "2").Commit();
+		EXPECT(watcher.Snapshot().get() == first);
+		EXPECT(watcher.Snapshot()->GetString("ftp.path", "") == "/b");
+		EXPECT(watcher.Snapshot()->GetInteger("limits.low", 0) == 2);
+
+		// Reloads too, replaying the file on the one that missed it
+		ReplaceFile(filename, "[ftp]\npath=/c\n[limits]\nlow=3\n");
+		EXPECT(WaitForPath(watcher, "/c") == true);
+		EXPECT(watcher.Snapshot().get() == second);
+		item.SetString("/d");
+		watcher.Set("ftp.path", item);
+		EXPECT(watcher.Snapshot().get() == first);
+		EXPECT(watcher.Snapshot()->GetInteger("limits.low", 0) == 3);
+
+		// A snapshot that is still held is copied instead, and stays as it was
+		std::shared_ptr<const config::Handler> held = watcher.Snapshot();
+		item.SetString("/e");
+		watcher.Set("ftp.path", item);
+		EXPECT(watcher.Snapshot().get() == second);
+		item.SetString("/f");
+		watcher.Set("ftp.path", item);
+		EXPECT(watcher.Snapshot().get() != first);
+		EXPECT(watcher.Snapshot().get() != second);
+		EXPECT(watcher.Snapshot()->GetString("ftp.path", "") == "/f");
+		EXPECT(watcher.Snapshot()->GetInteger("limits.low", 0) == 3);
+		EXPECT(held->GetString("ftp.path", "") == "/d");
+		EXPECT(watcher.Reloads() == 7u);
+
+		watcher.Stop();
+		std::filesystem::remove(filename);
+	},
+
+	CASE("A watcher follows symlink swaps like a Kubernetes ConfigMap volume") {
+		// config.ini -> ..data/config.ini, and ..data -> a versioned directory
+		std::filesystem::path directory = TemporaryFile("config_watcher_test_configmap");
+		std::filesystem::remove_all(directory);
+		std::filesystem::create_directories(directory / "..v1");
+		WriteFile((directory / "..v1" / "config.ini").string(), "[ftp]\npath=/a\n");
+		std::filesystem::create_directory_symlink("..v1", directory / "..data");
+		std::filesystem::create_symlink("..data/config.ini", directory / "config.ini");
+
+		config::ConfigWatcher watcher((directory / "config.ini").string(), {}, std::chrono::milliseconds(20));
+		watcher.Start();
+		EXPECT(watcher.Snapshot()->GetString("ftp.path", "") == "/a");
+
+		// Each update writes a new directory and renames a new ..data link
+		// over the old one, without touching config.ini.
+		for (const std::string version : {"..v2", "..v3"}) {
+			std::filesystem::create_directory(directory / version);
+			WriteFile((directory / version / "config.ini").string(), "[ftp]\npath=/" + version + "\n");
+			std::filesystem::create_directory_symlink(version, directory / "..data_tmp");
+			std::filesystem::rename(directory / "..data_tmp", directory / "..data");
+			EXPECT(WaitForPath(watcher, "/" + version) == true);
+		}
+
+		watcher.Stop();
+		std::filesystem::remove_all(directory);
+	},
+
+	CASE("A watcher does not start on an invalid file") {
+		std::string filename = TemporaryFile("config_watcher_invalid_test.ini");
+		WriteFile(filename, "[ftp]\nbad\n");
+		config::ConfigWatcher watcher(filename, {});
+		EXPECT_THROWS_AS(watcher.Start(), std::runtime_error);
+		std::filesystem::remove(filename);
+
+		config::ConfigWatcher missing(TemporaryFile("config_watcher_missing.ini"), {});
+		EXPECT_THROWS_AS(missing.Start(), std::runtime_error);
+	},
+
+	CASE("Derived values carry over to snapshots whose dependencies did not change") {
+		std::string filename = TemporaryFile("config_watcher_derive_test.ini");
+		WriteFile(filename, "[ftp]\npath=/a\n[limits]\nlow=1\nhigh=2\n");
+
+		config::ConfigWatcher watcher(filename, {}, std::chrono::milliseconds(20));
+		watcher.Start();
+		std::atomic<int> computed(0);
+		auto sum = [&](const config::Handler& settings) {
+			computed++;
+			return settings.GetInteger("limits.low", 0) + settings.GetInteger("limits.high", 0);
+		};
+		EXPECT(watcher.Snapshot()->Derive<int64_t>("sum", {"limits.low", "limits.high"}, sum) == 3);
+
+		config::Item item;
+		item.SetString("/b");
+		watcher.Set("ftp.path", item);
+		EXPECT(watcher.Snapshot()->Derive<int64_t>("sum", {"limits.low", "limits.high"}, sum) == 3);
+		EXPECT(computed == 1);
+
+		ReplaceFile(filename, "[ftp]\npath=/c\n[limits]\nlow=5\nhigh=2\n");
+		EXPECT(WaitForPath(watcher, "/c") == true);
+		EXPECT(watcher.Snapshot()->Derive<int64_t>("sum", {"limits.low", "limits.high"}, sum) == 7);
+		EXPECT(computed == 2);
+		watcher.Stop();
+		std::filesystem::remove(filename);
+	},
+};
+
+int main(int argc, char* argv[]) {
+	return lest::run(specification, argc, argv);
+}
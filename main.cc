@@ -1,8 +1,15 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <iterator>
 #include <sstream>
 
+#include "config/codegen.h"
+#include "config/daemon.h"
 #include "config/handler.h"
+#include "config/query.h"
+#include "config/store.h"
 
 // Helper function to print settings of heterogeneous types.
 void printSetting(config::Item* setting) {
@@ -26,6 +33,14 @@ void printSetting(config::Item* setting) {
 			std::cout << "[DBL]:\t" << setting->GetDouble() << "\n";
 			break;
 
+			case config::ValueType::SIZE:
+			std::cout << "[SIZE]:\t" << setting->GetSize() << " bytes\n";
+			break;
+
+			case config::ValueType::DURATION:
+			std::cout << "[DUR]:\t" << setting->GetDuration().count() << " ns\n";
+			break;
+
 			case config::ValueType::LIST:
 			std::cout << "[LIST]:\t{ ";
 			std::vector<std::string> list = setting->GetList();
@@ -39,7 +54,223 @@ void printSetting(config::Item* setting) {
 	}
 }
 
-int main() {
+// Print usage to standard error.
+int printUsage(const char* program) {
+	std::cerr << "Usage:\n"
+		<< "  " << program << "\t\t\t\tRun the demo against sample.ini\n"
+		<< "  " << program << " codegen schema.ini\tWrite a typed C++ header for a schema\n"
+		<< "  " << program << " daemon config.ini socket [override...]\n"
+		<< "\t\t\t\t\tServe lookups over a Unix domain socket\n"
+		<< "  " << program << " query [--format text|tsv|json] [--profile name]... config.ini [key...]\n"
+		<< "  " << program << " query [--format text|tsv|json] --snapshot file [key...]\n"
+		<< "\t\t\t\t\tLook up keys, or one key per line of standard input.\n"
+		<< "\t\t\t\t\tExits with 2 if any key is missing\n"
+		<< "  " << program << " snapshot [--profile name]... config.ini file\n"
+		<< "\t\t\t\t\tWrite a loaded config to a snapshot file for query\n"
+		<< "  " << program << " validate schema.ini config.ini [override...]\n"
+		<< "\t\t\t\t\tCheck a config against a schema's rules\n";
+	return 1;
+}
+
+// Generate a typed accessor header from a schema file and write it to
+// standard output. Errors go to standard error so they never end up in
+// the generated header.
+int runCodegen(const char* filename) {
+	try {
+		config::Handler schema;
+		if (!schema.Load(filename, {})) {
+			std::cerr << "Schema contains invalid settings: " << filename << "\n";
+			return 1;
+		}
+		config::Codegen codegen;
+		codegen.Generate(schema, filename, std::cout);
+	} catch (std::exception& e) {
+		std::cerr << "Encountered error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+// Check a config file against a schema file, and list the broken rules on
+// standard output. Exits with 1 if any rule is broken.
+int runValidate(const char* schemaFile, const char* filename, const std::vector<std::string>& overrides) {
+	try {
+		config::Handler handler;
+		handler.SetSchema(std::make_shared<const config::Schema>(schemaFile));
+		bool valid = handler.Load(filename, overrides);
+		for (const auto& violation : handler.GetViolations()) {
+			std::cout << violation.key << ": " << violation.message << "\n";
+		}
+		if (!valid && handler.GetViolations().empty()) {
+			std::cerr << "Config contains invalid settings: " << filename << "\n";
+		}
+		return valid ? 0 : 1;
+	} catch (std::exception& e) {
+		std::cerr << "Encountered error: " << e.what() << "\n";
+		return 1;
+	}
+}
+
+// The running daemon, stopped by SIGINT and SIGTERM.
+config::ConfigDaemon* runningDaemon = NULL;
+
+void stopDaemon(int) {
+	if (runningDaemon != NULL) {
+		runningDaemon->Stop();
+	}
+}
+
+// Serve a config file over a Unix domain socket until interrupted.
+int runDaemon(const char* filename, const char* socketPath, std::vector<std::string> overrides) {
+	try {
+		config::ConfigDaemon daemon(filename, overrides, socketPath);
+		daemon.Start();
+		runningDaemon = &daemon;
+		std::signal(SIGINT, stopDaemon);
+		std::signal(SIGTERM, stopDaemon);
+		daemon.Run();
+		runningDaemon = NULL;
+	} catch (std::exception& e) {
+		std::cerr << "Encountered error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+// Parse the options shared by query and snapshot, starting at argv[index].
+// Returns false on an unknown or incomplete option. Leaves index at the
+// first argument that is not an option.
+bool parseOptions(int argc, char* argv[], int& index, config::QueryFormat& format,
+	std::vector<std::string>& profiles, std::string& snapshot) {
+	for (; index < argc && std::string(argv[index]).rfind("--", 0) == 0; index++) {
+		std::string option = argv[index];
+		if (index + 1 == argc) {
+			return false;
+		}
+		std::string value = argv[++index];
+		if (option == "--format") {
+			if (!config::ParseQueryFormat(value, format)) {
+				return false;
+			}
+		} else if (option == "--profile") {
+			profiles.push_back(value);
+		} else if (option == "--snapshot") {
+			snapshot = value;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Load a config file into a store. Returns false, after printing why, if it
+// cannot be loaded.
+bool loadStore(const char* filename, const std::vector<std::string>& profiles, config::Store& store) {
+	try {
+		config::Handler handler;
+		if (!handler.Load(filename, profiles)) {
+			std::cerr << "Config contains invalid settings: " << filename << "\n";
+			return false;
+		}
+		store.Load(handler);
+	} catch (std::exception& e) {
+		std::cerr << "Encountered error: " << e.what() << "\n";
+		return false;
+	}
+	return true;
+}
+
+// Look up many keys with a single load. The config is loaded once, frozen
+// into a store, and every result is formatted into one output buffer.
+int runQuery(int argc, char* argv[]) {
+	config::QueryFormat format = config::QueryFormat::TEXT;
+	std::vector<std::string> profiles;
+	std::string snapshot;
+	int index = 2;
+	if (!parseOptions(argc, argv, index, format, profiles, snapshot)) {
+		return printUsage(argv[0]);
+	}
+
+	config::Store store;
+	if (snapshot.empty()) {
+		if (index == argc) {
+			return printUsage(argv[0]);
+		}
+		if (!loadStore(argv[index++], profiles, store)) {
+			return 1;
+		}
+	} else {
+		// Overrides were resolved when the snapshot was written.
+		if (!profiles.empty()) {
+			return printUsage(argv[0]);
+		}
+		try {
+			if (!store.Open(snapshot)) {
+				std::cerr << "Not a valid snapshot: " << snapshot << "\n";
+				return 1;
+			}
+		} catch (std::exception& e) {
+			std::cerr << "Encountered error: " << e.what() << "\n";
+			return 1;
+		}
+	}
+
+	config::QueryWriter writer(stdout, format);
+	if (index < argc) {
+		for (; index < argc; index++) {
+			writer.Write(argv[index], store.Get(argv[index]));
+		}
+	} else {
+		// getline reuses one buffer for every line.
+		char* line = NULL;
+		size_t capacity = 0;
+		ssize_t length;
+		while ((length = getline(&line, &capacity, stdin)) >= 0) {
+			std::string_view key(line, length);
+			while (!key.empty() && isspace(static_cast<unsigned char>(key.back()))) {
+				key.remove_suffix(1);
+			}
+			while (!key.empty() && isspace(static_cast<unsigned char>(key.front()))) {
+				key.remove_prefix(1);
+			}
+			if (!key.empty()) {
+				writer.Write(key, store.Get(key));
+			}
+		}
+		free(line);
+	}
+	if (!writer.Finish()) {
+		std::cerr << "Unable to write output\n";
+		return 1;
+	}
+	return writer.Missing() > 0 ? 2 : 0;
+}
+
+// Load a config file and write it to a snapshot file for query.
+int runSnapshot(int argc, char* argv[]) {
+	config::QueryFormat format;
+	std::vector<std::string> profiles;
+	std::string snapshot;
+	int index = 2;
+	if (!parseOptions(argc, argv, index, format, profiles, snapshot) || !snapshot.empty()
+		|| argc - index != 2) {
+		return printUsage(argv[0]);
+	}
+	config::Store store;
+	if (!loadStore(argv[index], profiles, store)) {
+		return 1;
+	}
+	try {
+		store.Save(argv[index + 1]);
+	} catch (std::exception& e) {
+		std::cerr << "Encountered error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+// Load sample.ini and print a few settings.
+int runDemo() {
 	try {
 		// Get a config handler
 		config::Handler handler;
@@ -96,3 +327,26 @@ int main() {
 
 	return 0;
 }
+
+int main(int argc, char* argv[]) {
+	if (argc == 1) {
+		return runDemo();
+	}
+	std::string mode = argv[1];
+	if (mode == "codegen" && argc == 3) {
+		return runCodegen(argv[2]);
+	}
+	if (mode == "query") {
+		return runQuery(argc, argv);
+	}
+	if (mode == "snapshot") {
+		return runSnapshot(argc, argv);
+	}
+	if (mode == "validate" && argc >= 4) {
+		return runValidate(argv[2], argv[3], std::vector<std::string>(argv + 4, argv + argc));
+	}
+	if (mode == "daemon" && argc >= 4) {
+		return runDaemon(argv[2], argv[3], std::vector<std::string>(argv + 4, argv + argc));
+	}
+	return printUsage(argv[0]);
+}